@@ -5,3 +5,5 @@ sudo apt-get install binutils
 sudo apt-get install libc6-dev-i386
 sudo apt-get install xorriso
 sudo apt-get install grub
+sudo apt-get install dosfstools
+sudo apt-get install mtools
@@ -0,0 +1,539 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ *
+ * ahci.c
+ */
+
+#include "ahci.h"
+#include "pci.h"
+#include "memory.h"
+#include "string.h"
+#include "time.h"
+#include <stdint.h>
+
+// PCI: mass storage / SATA / AHCI 1.0
+#define AHCI_PROG_IF       0x01
+#define AHCI_ABAR          5       // registers live in memory BAR5
+
+// generic host control registers
+#define HBA_CAP            0x00
+#define HBA_GHC            0x04
+#define HBA_IS             0x08
+#define HBA_PI             0x0C
+#define HBA_CAP2           0x24
+#define HBA_BOHC           0x28
+
+#define HBA_CAP_SNCQ       (1u << 30)  // native command queuing
+#define HBA_GHC_AE         (1u << 31)  // AHCI enable
+#define HBA_GHC_IE         (1u << 1)   // interrupt enable
+#define HBA_CAP2_BOH       (1u << 0)   // BIOS/OS handoff supported
+#define HBA_BOHC_BOS       (1u << 0)   // BIOS owns the controller
+#define HBA_BOHC_OOS       (1u << 1)   // OS wants it
+
+// port registers, at 0x100 + port * 0x80
+#define PORT_BASE(p)       (0x100 + (p) * 0x80)
+#define PORT_CLB           0x00
+#define PORT_CLBU          0x04
+#define PORT_FB            0x08
+#define PORT_FBU           0x0C
+#define PORT_IS            0x10
+#define PORT_IE            0x14
+#define PORT_CMD           0x18
+#define PORT_TFD           0x20
+#define PORT_SIG           0x24
+#define PORT_SSTS          0x28
+#define PORT_SCTL          0x2C
+#define PORT_SERR          0x30
+#define PORT_SACT          0x34
+#define PORT_CI            0x38
+
+#define PORT_CMD_ST        (1u << 0)
+#define PORT_CMD_FRE       (1u << 4)
+#define PORT_CMD_FR        (1u << 14)
+#define PORT_CMD_CR        (1u << 15)
+
+// task file error, host bus fatal/data error, interface fatal error
+#define PORT_IS_ERRORS     ((1u << 30) | (1u << 29) | (1u << 28) | (1u << 27))
+
+#define PORT_TFD_ERR       0x01
+#define PORT_TFD_DRQ       0x08
+#define PORT_TFD_BSY       0x80
+
+#define SSTS_DET_MASK      0x0F
+#define SSTS_DET_PRESENT   3       // device detected, phy up
+
+// signatures of devices that are not plain disks
+#define SATA_SIG_ATAPI     0xEB140101u
+#define SATA_SIG_SEMB      0xC33C0101u
+#define SATA_SIG_PM        0x96690101u
+
+#define FIS_TYPE_REG_H2D   0x27
+
+// ATA commands
+#define ATA_CMD_IDENTIFY        0xEC
+#define ATA_CMD_READ_DMA        0xC8
+#define ATA_CMD_WRITE_DMA       0xCA
+#define ATA_CMD_READ_DMA_EXT    0x25
+#define ATA_CMD_WRITE_DMA_EXT   0x35
+#define ATA_CMD_READ_FPDMA      0x60   // NCQ
+#define ATA_CMD_WRITE_FPDMA     0x61
+#define ATA_CMD_FLUSH_CACHE     0xE7
+#define ATA_CMD_FLUSH_CACHE_EXT 0xEA
+
+#define AHCI_MAX_UNITS     8
+#define AHCI_MAX_SLOTS     32
+#define AHCI_CMD_MAX_SECTORS 8192  // one PRD entry moves at most 4 MiB
+#define AHCI_SPLIT_MIN     64      // don't split requests into commands under 32 KiB
+#define AHCI_BOUNCE_SECTORS 128    // for buffers the HBA can't address directly
+#define AHCI_LBA28_LIMIT   0x10000000ULL
+
+#define AHCI_TIMEOUT_MS       5000
+#define AHCI_FLUSH_TIMEOUT_MS 30000
+#define AHCI_STOP_TIMEOUT_MS  500
+
+// command list entry
+typedef struct {
+    uint16_t flags;              // CFL (FIS length in dwords) in bits 0..4, W = bit 6
+    uint16_t prdtl;              // PRD table length
+    volatile uint32_t prdbc;     // bytes transferred, written by the HBA
+    uint32_t ctba;               // command table address (128-byte aligned)
+    uint32_t ctbau;
+    uint32_t reserved[4];
+} __attribute__((packed)) ahci_cmd_header_t;
+
+#define AHCI_CMD_WRITE     0x0040
+#define AHCI_CFL_H2D       5
+
+typedef struct {
+    uint32_t dba;                // data address (word aligned)
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t dbc;                // byte count - 1, at most 4 MiB
+} __attribute__((packed)) ahci_prd_t;
+
+// one table per command slot; padded to 256 bytes so each stays aligned
+typedef struct {
+    uint8_t    cfis[64];
+    uint8_t    acmd[16];
+    uint8_t    reserved[48];
+    ahci_prd_t prdt[1];
+    uint8_t    pad[112];
+} __attribute__((packed)) ahci_cmd_table_t;
+
+typedef struct {
+    volatile uint8_t  *regs;     // port register block
+    int                port;
+    uint8_t            ncq;      // queued commands in use
+    uint8_t            lba48;
+    uint8_t            slots;    // commands that may be in flight at once
+    uint8_t            hba_slots;
+    uint8_t            hba_ncq;
+    uint64_t           sectors;
+    ahci_cmd_header_t *cmd_list;
+    uint8_t           *fis;
+    ahci_cmd_table_t  *tables;
+    uint8_t           *bounce;
+} ahci_unit_t;
+
+static ahci_unit_t units[AHCI_MAX_UNITS];
+static int unit_count = 0;
+static int initialized = 0;
+
+//------------------------------------------------------------
+// Register access
+//------------------------------------------------------------
+static inline uint32_t mmio_read(volatile uint8_t *base, uint32_t reg) {
+    return *(volatile uint32_t *)(base + reg);
+}
+
+static inline void mmio_write(volatile uint8_t *base, uint32_t reg, uint32_t value) {
+    *(volatile uint32_t *)(base + reg) = value;
+}
+
+//------------------------------------------------------------
+// Port start/stop/reset
+//------------------------------------------------------------
+static int ahci_port_stop(volatile uint8_t *regs) {
+    mmio_write(regs, PORT_CMD, mmio_read(regs, PORT_CMD) & ~(PORT_CMD_ST | PORT_CMD_FRE));
+
+    uint32_t start = get_time_ms();
+    while (mmio_read(regs, PORT_CMD) & (PORT_CMD_CR | PORT_CMD_FR)) {
+        if (get_time_ms() - start >= AHCI_STOP_TIMEOUT_MS) return -1;
+    }
+    return 0;
+}
+
+static void ahci_port_start(volatile uint8_t *regs) {
+    uint32_t start = get_time_ms();
+    while ((mmio_read(regs, PORT_CMD) & PORT_CMD_CR) &&
+           get_time_ms() - start < AHCI_STOP_TIMEOUT_MS) {
+    }
+    mmio_write(regs, PORT_CMD, mmio_read(regs, PORT_CMD) | PORT_CMD_FRE);
+    mmio_write(regs, PORT_CMD, mmio_read(regs, PORT_CMD) | PORT_CMD_ST);
+}
+
+// wait for the device to drop BSY/DRQ, e.g. while it spins up
+static int ahci_wait_ready(ahci_unit_t *u, uint32_t timeout_ms) {
+    uint32_t start = get_time_ms();
+    while (mmio_read(u->regs, PORT_TFD) & (PORT_TFD_BSY | PORT_TFD_DRQ)) {
+        if (get_time_ms() - start >= timeout_ms) return -1;
+    }
+    return 0;
+}
+
+// COMRESET the link after an error; also throws away any queued commands
+static void ahci_port_reset(ahci_unit_t *u) {
+    volatile uint8_t *regs = u->regs;
+
+    ahci_port_stop(regs);
+
+    uint32_t sctl = mmio_read(regs, PORT_SCTL) & ~0x0Fu;
+    mmio_write(regs, PORT_SCTL, sctl | 1);   // DET = 1: start COMRESET
+    delay_ms(2);                             // must be held at least 1 ms
+    mmio_write(regs, PORT_SCTL, sctl);
+
+    uint32_t start = get_time_ms();
+    while ((mmio_read(regs, PORT_SSTS) & SSTS_DET_MASK) != SSTS_DET_PRESENT &&
+           get_time_ms() - start < AHCI_STOP_TIMEOUT_MS) {
+    }
+
+    mmio_write(regs, PORT_SERR, 0xFFFFFFFFu);
+    mmio_write(regs, PORT_IS, 0xFFFFFFFFu);
+    ahci_port_start(regs);
+    ahci_wait_ready(u, AHCI_TIMEOUT_MS);
+}
+
+// point the port at its command list and FIS area and start it
+static int ahci_port_setup(ahci_unit_t *u) {
+    if (ahci_port_stop(u->regs) < 0) return -1;
+
+    // a unit that failed to come up hands its memory to the next port
+    if (!u->cmd_list) {
+        u->cmd_list = high_alloc(AHCI_MAX_SLOTS * sizeof(ahci_cmd_header_t), 1024);
+        u->fis      = high_alloc(256, 256);
+        u->tables   = high_alloc(AHCI_MAX_SLOTS * sizeof(ahci_cmd_table_t), 128);
+        u->bounce   = high_alloc(AHCI_BOUNCE_SECTORS * 512, 512);
+    }
+    if (!u->cmd_list || !u->fis || !u->tables || !u->bounce) return -1;
+
+    memset(u->cmd_list, 0, AHCI_MAX_SLOTS * sizeof(ahci_cmd_header_t));
+    memset(u->fis, 0, 256);
+    memset(u->tables, 0, AHCI_MAX_SLOTS * sizeof(ahci_cmd_table_t));
+    for (int i = 0; i < AHCI_MAX_SLOTS; i++) {
+        u->cmd_list[i].ctba = (uint32_t)&u->tables[i];  // no paging: virtual == physical
+    }
+
+    mmio_write(u->regs, PORT_CLB, (uint32_t)u->cmd_list);
+    mmio_write(u->regs, PORT_CLBU, 0);
+    mmio_write(u->regs, PORT_FB, (uint32_t)u->fis);
+    mmio_write(u->regs, PORT_FBU, 0);
+
+    mmio_write(u->regs, PORT_SERR, 0xFFFFFFFFu);
+    mmio_write(u->regs, PORT_IS, 0xFFFFFFFFu);
+    mmio_write(u->regs, PORT_IE, 0);  // completions are polled
+
+    ahci_port_start(u->regs);
+    return 0;
+}
+
+//------------------------------------------------------------
+// Commands
+//------------------------------------------------------------
+
+// fill command slot `slot`. queued: NCQ (FPDMA) layout, where the count
+// moves to the features register and the tag into the count register
+static void ahci_build(ahci_unit_t *u, int slot, uint8_t command, uint64_t lba, UINT count,
+                       BYTE *buf, uint32_t bytes, int write, int queued) {
+    ahci_cmd_header_t *h = &u->cmd_list[slot];
+    ahci_cmd_table_t  *t = &u->tables[slot];
+    uint8_t *fis = t->cfis;
+
+    memset(fis, 0, sizeof(t->cfis));
+    fis[0] = FIS_TYPE_REG_H2D;
+    fis[1] = 0x80;                                // this FIS carries a command
+    fis[2] = command;
+    fis[4] = (uint8_t)lba;
+    fis[5] = (uint8_t)(lba >> 8);
+    fis[6] = (uint8_t)(lba >> 16);
+    fis[7] = (command == ATA_CMD_IDENTIFY) ? 0x00 : 0x40;  // LBA mode
+    fis[8] = (uint8_t)(lba >> 24);
+    fis[9] = (uint8_t)(lba >> 32);
+    fis[10] = (uint8_t)(lba >> 40);
+
+    if (queued) {
+        fis[3]  = (uint8_t)count;                 // features: sector count (65536 -> 0)
+        fis[11] = (uint8_t)(count >> 8);
+        fis[12] = (uint8_t)(slot << 3);           // count: tag
+    } else {
+        fis[12] = (uint8_t)count;
+        fis[13] = (uint8_t)(count >> 8);
+        if (!u->lba48 && command != ATA_CMD_IDENTIFY) {
+            fis[7] |= (uint8_t)((lba >> 24) & 0x0F);  // 28-bit: LBA 24..27 in device
+        }
+    }
+
+    if (buf) {
+        t->prdt[0].dba      = (uint32_t)buf;
+        t->prdt[0].dbau     = 0;
+        t->prdt[0].reserved = 0;
+        t->prdt[0].dbc      = bytes - 1;
+        h->prdtl = 1;
+    } else {
+        h->prdtl = 0;
+    }
+    h->flags = AHCI_CFL_H2D | (write ? AHCI_CMD_WRITE : 0);
+    h->prdbc = 0;
+}
+
+// hand the slots in mask to the HBA and wait until all of them completed.
+// returns 0, or -1 on a device error or timeout
+static int ahci_run(ahci_unit_t *u, uint32_t mask, int queued, uint32_t timeout_ms) {
+    // tables and (for writes) data must be in memory before the HBA looks
+    __asm__ volatile ("" ::: "memory");
+
+    mmio_write(u->regs, PORT_IS, 0xFFFFFFFFu);
+    if (queued) mmio_write(u->regs, PORT_SACT, mask);
+    mmio_write(u->regs, PORT_CI, mask);
+    for (uint32_t m = mask; m; m &= m - 1) disk_note_commands(1);
+
+    uint32_t start = get_time_ms();
+    for (;;) {
+        if (mmio_read(u->regs, PORT_IS) & PORT_IS_ERRORS) break;
+        uint32_t busy = mmio_read(u->regs, PORT_CI) | mmio_read(u->regs, PORT_SACT);
+        if (!(busy & mask)) {
+            // the HBA wrote into our buffers behind the compiler's back
+            __asm__ volatile ("" ::: "memory");
+            return 0;
+        }
+        if (get_time_ms() - start >= timeout_ms) {
+            disk_note_timeout();
+            break;
+        }
+    }
+
+    ahci_port_reset(u);
+    return -1;
+}
+
+static uint8_t ahci_rw_command(ahci_unit_t *u, int write) {
+    if (u->ncq) return write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA;
+    if (u->lba48) return write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+    return write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA;
+}
+
+// move count sectors. large transfers are cut into up to u->slots
+// commands that are all in flight together
+static int ahci_transfer(ahci_unit_t *u, BYTE *buf, uint64_t lba, UINT count, int write) {
+    // PRD addresses must be word aligned; go through the bounce buffer otherwise
+    if ((uint32_t)buf & 1) {
+        while (count > 0) {
+            UINT n = (count > AHCI_BOUNCE_SECTORS) ? AHCI_BOUNCE_SECTORS : count;
+            if (write) memcpy(u->bounce, buf, n * 512);
+            if (ahci_transfer(u, u->bounce, lba, n, write) < 0) return -1;
+            if (!write) memcpy(buf, u->bounce, n * 512);
+            buf += n * 512;
+            lba += n;
+            count -= n;
+        }
+        return 0;
+    }
+
+    UINT max_cmd = u->lba48 ? AHCI_CMD_MAX_SECTORS : 256;
+
+    while (count > 0) {
+        UINT per = count / u->slots;
+        if (per < AHCI_SPLIT_MIN) per = AHCI_SPLIT_MIN;
+        if (per > max_cmd) per = max_cmd;
+
+        uint32_t mask = 0;
+        for (int slot = 0; slot < u->slots && count > 0; slot++) {
+            UINT n = (count < per) ? count : per;
+            ahci_build(u, slot, ahci_rw_command(u, write), lba, n, buf, n * 512, write, u->ncq);
+            mask |= 1u << slot;
+            buf   += n * 512;
+            lba   += n;
+            count -= n;
+        }
+
+        if (ahci_run(u, mask, u->ncq, AHCI_TIMEOUT_MS) < 0) return -1;
+    }
+    return 0;
+}
+
+static int ahci_identify(ahci_unit_t *u) {
+    uint16_t *id = (uint16_t *)u->bounce;
+
+    if (ahci_wait_ready(u, AHCI_TIMEOUT_MS) < 0) return -1;
+
+    ahci_build(u, 0, ATA_CMD_IDENTIFY, 0, 0, u->bounce, 512, 0, 0);
+    if (ahci_run(u, 1, 0, AHCI_TIMEOUT_MS) < 0) return -1;
+
+    u->sectors = ((uint32_t)id[61] << 16) | id[60];
+
+    // word 83 bit 10: 48-bit feature set; words 100..103 hold the 48-bit size
+    u->lba48 = (id[83] & 0x0400) ? 1 : 0;
+    if (u->lba48) {
+        uint64_t n = (uint64_t)id[100]
+                   | ((uint64_t)id[101] << 16)
+                   | ((uint64_t)id[102] << 32)
+                   | ((uint64_t)id[103] << 48);
+        if (n > u->sectors) u->sectors = n;
+    }
+    if (u->sectors == 0) return -1;
+
+    // word 76 bit 8: NCQ supported; word 75 bits 0..4: queue depth - 1
+    u->ncq = 0;
+    u->slots = 1;
+    if (u->hba_ncq && u->lba48 && id[76] != 0xFFFF && (id[76] & 0x0100)) {
+        int depth = (id[75] & 0x1F) + 1;
+        u->ncq = 1;
+        u->slots = (depth < u->hba_slots) ? depth : u->hba_slots;
+    }
+    return 0;
+}
+
+//------------------------------------------------------------
+// Controller bring-up
+//------------------------------------------------------------
+static void ahci_hba_init(volatile uint8_t *abar) {
+    // take the controller over from the BIOS if it says it owns it
+    if (mmio_read(abar, HBA_CAP2) & HBA_CAP2_BOH) {
+        mmio_write(abar, HBA_BOHC, mmio_read(abar, HBA_BOHC) | HBA_BOHC_OOS);
+        uint32_t start = get_time_ms();
+        while ((mmio_read(abar, HBA_BOHC) & HBA_BOHC_BOS) && get_time_ms() - start < 2000) {
+        }
+    }
+
+    mmio_write(abar, HBA_GHC, (mmio_read(abar, HBA_GHC) | HBA_GHC_AE) & ~HBA_GHC_IE);
+
+    uint32_t cap = mmio_read(abar, HBA_CAP);
+    uint8_t slots = (uint8_t)(((cap >> 8) & 0x1F) + 1);
+    uint8_t ncq = (cap & HBA_CAP_SNCQ) ? 1 : 0;
+    uint32_t pi = mmio_read(abar, HBA_PI);
+
+    for (int port = 0; port < 32 && unit_count < AHCI_MAX_UNITS; port++) {
+        if (!(pi & (1u << port))) continue;
+
+        volatile uint8_t *regs = abar + PORT_BASE(port);
+        if ((mmio_read(regs, PORT_SSTS) & SSTS_DET_MASK) != SSTS_DET_PRESENT) continue;
+
+        ahci_unit_t *u = &units[unit_count];
+        u->regs      = regs;
+        u->port      = port;
+        u->hba_slots = slots;
+        u->hba_ncq   = ncq;
+
+        if (ahci_port_setup(u) < 0) continue;
+
+        uint32_t sig = mmio_read(regs, PORT_SIG);
+        if (sig == SATA_SIG_ATAPI || sig == SATA_SIG_SEMB || sig == SATA_SIG_PM ||
+            ahci_identify(u) < 0) {
+            ahci_port_stop(regs);
+            continue;
+        }
+        unit_count++;
+    }
+
+    mmio_write(abar, HBA_IS, 0xFFFFFFFFu);
+}
+
+int ahci_init(void) {
+    if (initialized) return unit_count;
+    initialized = 1;
+
+    pci_device_t dev;
+    for (int i = 0; pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_SATA, i, &dev); i++) {
+        if (dev.prog_if != AHCI_PROG_IF) continue;
+
+        uint32_t abar = pci_read_bar(&dev, AHCI_ABAR);
+        if (abar == 0) continue;
+
+        pci_enable(&dev, PCI_CMD_MEM_SPACE | PCI_CMD_BUS_MASTER);
+        ahci_hba_init((volatile uint8_t *)abar);
+    }
+    return unit_count;
+}
+
+//------------------------------------------------------------
+// Block device interface (diskio.c)
+//------------------------------------------------------------
+static ahci_unit_t* ahci_unit(BYTE unit) {
+    return (unit < unit_count) ? &units[unit] : NULL;
+}
+
+static int ahci_reachable(ahci_unit_t *u, LBA_t sector, UINT count) {
+    uint64_t end = (uint64_t)sector + count;
+    if (end > u->sectors) return 0;
+    if (!u->lba48 && end > AHCI_LBA28_LIMIT) return 0;
+    return 1;
+}
+
+DSTATUS ahci_disk_initialize(BYTE unit) {
+    ahci_unit_t *u = ahci_unit(unit);
+    if (!u) return STA_NOINIT;
+    if ((mmio_read(u->regs, PORT_SSTS) & SSTS_DET_MASK) != SSTS_DET_PRESENT) return STA_NOINIT;
+    return 0;
+}
+
+// one retry without queuing if a queued transfer fails, much like the
+// ATA driver falls back from DMA to PIO
+static DRESULT ahci_rw(BYTE unit, BYTE *buff, LBA_t sector, UINT count, int write) {
+    ahci_unit_t *u = ahci_unit(unit);
+    if (!u)                                return RES_NOTRDY;
+    if (count == 0)                        return RES_PARERR;
+    if (!ahci_reachable(u, sector, count)) return RES_PARERR;
+
+    if (ahci_transfer(u, buff, sector, count, write) == 0) return RES_OK;
+
+    if (u->ncq) {
+        u->ncq = 0;
+        u->slots = 1;
+        disk_note_retry();
+        if (ahci_transfer(u, buff, sector, count, write) == 0) return RES_OK;
+    }
+    return RES_ERROR;
+}
+
+DRESULT ahci_disk_read(BYTE unit, BYTE *buff, LBA_t sector, UINT count) {
+    return ahci_rw(unit, buff, sector, count, 0);
+}
+
+DRESULT ahci_disk_write(BYTE unit, const BYTE *buff, LBA_t sector, UINT count) {
+    // the HBA only reads from buff for writes
+    return ahci_rw(unit, (BYTE *)buff, sector, count, 1);
+}
+
+DRESULT ahci_disk_ioctl(BYTE unit, BYTE cmd, void *buff) {
+    ahci_unit_t *u = ahci_unit(unit);
+    if (!u) return RES_NOTRDY;
+
+    switch (cmd) {
+        case CTRL_SYNC:
+            ahci_build(u, 0, u->lba48 ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE,
+                       0, 0, NULL, 0, 0, 0);
+            return (ahci_run(u, 1, 0, AHCI_FLUSH_TIMEOUT_MS) == 0) ? RES_OK : RES_ERROR;
+        case GET_SECTOR_COUNT:
+            *(LBA_t *)buff = (u->sectors > (LBA_t)-1) ? (LBA_t)-1 : (LBA_t)u->sectors;
+            return RES_OK;
+        case GET_SECTOR_SIZE:
+            *(WORD *)buff = 512;
+            return RES_OK;
+        case GET_BLOCK_SIZE:
+            *(DWORD *)buff = 1;
+            return RES_OK;
+        default:
+            return RES_PARERR;
+    }
+}
+
+int ahci_unit_port(BYTE unit) {
+    ahci_unit_t *u = ahci_unit(unit);
+    return u ? u->port : -1;
+}
+
+int ahci_unit_ncq(BYTE unit) {
+    ahci_unit_t *u = ahci_unit(unit);
+    return u ? u->ncq : 0;
+}
@@ -0,0 +1,32 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ *
+ * ahci.h
+ */
+
+#ifndef AHCI_H
+#define AHCI_H
+
+#include "ff.h"
+#include "diskio.h"
+#include <stdint.h>
+
+// SATA disks behind an AHCI controller (PCI class 01/06/01). Each disk is
+// a "unit" numbered from 0; diskio.c registers them as physical drives.
+
+// Find the controller and bring up every port with a disk attached.
+// Returns the number of units. Safe to call again.
+int ahci_init(void);
+
+DSTATUS ahci_disk_initialize(BYTE unit);
+DRESULT ahci_disk_read(BYTE unit, BYTE *buff, LBA_t sector, UINT count);
+DRESULT ahci_disk_write(BYTE unit, const BYTE *buff, LBA_t sector, UINT count);
+DRESULT ahci_disk_ioctl(BYTE unit, BYTE cmd, void *buff);
+
+// Port number of a unit and whether it runs with native command queuing
+int ahci_unit_port(BYTE unit);
+int ahci_unit_ncq(BYTE unit);
+
+#endif // AHCI_H
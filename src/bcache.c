@@ -0,0 +1,507 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ * 
+ * bcache.c
+ */
+
+#include "bcache.h"
+#include "memory.h"
+#include "string.h"
+#include "time.h"
+#include <stdint.h>
+
+#define BCACHE_SECTOR      512
+#define BCACHE_MIN_BLOCKS  64      // 32 KB
+#define BCACHE_MAX_BLOCKS  8192    // 4 MB
+#define BCACHE_MEM_SHARE   8       // take at most 1/8 of free memory
+
+// transfers longer than this are file data being streamed; caching them
+// would only push the FAT and directory sectors out
+#define BCACHE_MAX_INSERT  64
+
+// write-back: dirty blocks go out once the disk has been quiet for
+// BCACHE_IDLE_MS, or at the latest BCACHE_DIRTY_MS after the first one
+// was dirtied, or when more than half of the cache is dirty
+#define BCACHE_IDLE_MS     500
+#define BCACHE_DIRTY_MS    5000
+#define BCACHE_FLUSH_RUN   128     // sectors per write command while flushing
+
+// read-ahead: a miss that continues where the previous read on the drive
+// stopped fetches a window of extra sectors, doubling from RA_MIN_WINDOW
+// up to RA_MAX_WINDOW while the reader stays sequential and dropping to
+// nothing when it seeks. Sequential data is kept in a per-drive buffer,
+// not the LRU; other misses are cached as usual
+#define RA_MIN_WINDOW      8
+#define RA_MAX_WINDOW      256
+#define RA_BUF_SECTORS     (RA_MAX_WINDOW + BCACHE_MAX_INSERT)
+
+typedef struct bcache_block {
+    struct bcache_block *hnext;   // next block in the same hash bucket
+    struct bcache_block *prev;    // LRU list, head = most recently used
+    struct bcache_block *next;
+    LBA_t  lba;
+    BYTE   drv;
+    BYTE   valid;
+    BYTE   dirty;     // newer than the drive (write-back mode only)
+    BYTE  *data;
+} bcache_block;
+
+static bcache_block  *blocks   = NULL;
+static bcache_block **buckets  = NULL;
+static uint32_t nblocks   = 0;
+static uint32_t hash_mask = 0;
+
+static bcache_block *lru_head = NULL;
+static bcache_block *lru_tail = NULL;
+
+static bcache_stats_t stats;
+
+static int writeback = 0;
+static uint32_t first_dirty_ms = 0;      // when the oldest dirty block was written
+static uint32_t last_write_ms  = 0;      // last write request from FatFs
+
+static bcache_block **flush_list = NULL; // scratch for sorting dirty blocks
+static BYTE *flush_buf = NULL;           // one coalesced run
+
+typedef struct {
+    LBA_t next_lba;   // where a sequential reader would continue
+    UINT  window;     // sectors fetched past a sequential miss, 0 = off
+    LBA_t buf_lba;    // first sector held in buf
+    UINT  buf_count;  // sectors held (0 = empty)
+    UINT  buf_used;   // of those, handed to a reader
+    BYTE *buf;        // RA_BUF_SECTORS, allocated when first needed
+} bcache_ra;
+
+static bcache_ra ra[MAX_DRIVES];
+
+//------------------------------------------------------------
+// LRU list and hash table helpers
+//------------------------------------------------------------
+static inline uint32_t bcache_hash(BYTE drv, LBA_t lba) {
+    return ((uint32_t)lba * 2654435761u ^ (uint32_t)drv * 0x9E3779B1u) & hash_mask;
+}
+
+static void lru_unlink(bcache_block *b) {
+    if (b->prev) b->prev->next = b->next; else lru_head = b->next;
+    if (b->next) b->next->prev = b->prev; else lru_tail = b->prev;
+    b->prev = b->next = NULL;
+}
+
+static void lru_push_head(bcache_block *b) {
+    b->prev = NULL;
+    b->next = lru_head;
+    if (lru_head) lru_head->prev = b; else lru_tail = b;
+    lru_head = b;
+}
+
+static void lru_push_tail(bcache_block *b) {
+    b->next = NULL;
+    b->prev = lru_tail;
+    if (lru_tail) lru_tail->next = b; else lru_head = b;
+    lru_tail = b;
+}
+
+static void lru_touch(bcache_block *b) {
+    if (lru_head == b) return;
+    lru_unlink(b);
+    lru_push_head(b);
+}
+
+static bcache_block* bcache_lookup(BYTE drv, LBA_t lba) {
+    bcache_block *b = buckets[bcache_hash(drv, lba)];
+    while (b) {
+        if (b->lba == lba && b->drv == drv) return b;
+        b = b->hnext;
+    }
+    return NULL;
+}
+
+static void hash_remove(bcache_block *b) {
+    bcache_block **pp = &buckets[bcache_hash(b->drv, b->lba)];
+    while (*pp) {
+        if (*pp == b) {
+            *pp = b->hnext;
+            break;
+        }
+        pp = &(*pp)->hnext;
+    }
+    b->hnext = NULL;
+}
+
+// drop a block and make it the next victim
+static void bcache_drop(bcache_block *b) {
+    hash_remove(b);
+    if (b->dirty) stats.dirty--;
+    b->dirty = 0;
+    b->valid = 0;
+    stats.used--;
+    lru_unlink(b);
+    lru_push_tail(b);
+}
+
+static DRESULT bcache_flush_blocks(BYTE drv);
+static void ra_forget(BYTE drv, LBA_t sector, UINT count);
+
+// store one sector, reusing the least recently used block if needed.
+// returns -1 if the victim was dirty and could not be written back
+static int bcache_insert(BYTE drv, LBA_t lba, const BYTE *data, int dirty) {
+    bcache_block *b = bcache_lookup(drv, lba);
+    if (!b) {
+        b = lru_tail;
+        if (b->dirty) {
+            // write the whole drive's dirty set while we're at it
+            if (bcache_flush_blocks(b->drv) != RES_OK) return -1;
+        }
+        if (b->valid) {
+            hash_remove(b);
+        } else {
+            stats.used++;
+        }
+        b->drv   = drv;
+        b->lba   = lba;
+        b->valid = 1;
+
+        uint32_t h = bcache_hash(drv, lba);
+        b->hnext = buckets[h];
+        buckets[h] = b;
+    }
+    memcpy(b->data, data, BCACHE_SECTOR);
+    if (dirty && !b->dirty) stats.dirty++;
+    if (!dirty && b->dirty) stats.dirty--;
+    b->dirty = dirty ? 1 : 0;
+    lru_touch(b);
+    return 0;
+}
+
+// order for flushing: by drive, then by LBA
+static int bcache_before(const bcache_block *a, const bcache_block *b) {
+    if (a->drv != b->drv) return a->drv < b->drv;
+    return a->lba < b->lba;
+}
+
+// write out dirty blocks (drv = BCACHE_ALL_DRIVES for every drive) in
+// LBA order, merging neighbouring sectors into multi-sector commands
+static DRESULT bcache_flush_blocks(BYTE drv) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < nblocks; i++) {
+        if (blocks[i].dirty && (drv == BCACHE_ALL_DRIVES || blocks[i].drv == drv)) {
+            flush_list[n++] = &blocks[i];
+        }
+    }
+    if (n == 0) return RES_OK;
+
+    // shell sort; the list is at most a few thousand entries
+    for (uint32_t gap = n / 2; gap > 0; gap /= 2) {
+        for (uint32_t i = gap; i < n; i++) {
+            bcache_block *t = flush_list[i];
+            uint32_t j = i;
+            while (j >= gap && bcache_before(t, flush_list[j - gap])) {
+                flush_list[j] = flush_list[j - gap];
+                j -= gap;
+            }
+            flush_list[j] = t;
+        }
+    }
+
+    DRESULT res = RES_OK;
+    uint32_t i = 0;
+    while (i < n) {
+        bcache_block *first = flush_list[i];
+        uint32_t run = 1;
+        while (i + run < n && run < BCACHE_FLUSH_RUN &&
+               flush_list[i + run]->drv == first->drv &&
+               flush_list[i + run]->lba == first->lba + run) {
+            run++;
+        }
+
+        for (uint32_t k = 0; k < run; k++) {
+            memcpy(flush_buf + k * BCACHE_SECTOR, flush_list[i + k]->data, BCACHE_SECTOR);
+        }
+
+        stats.write_cmds++;
+        if (disk_write_direct(first->drv, flush_buf, first->lba, run) == RES_OK) {
+            stats.written += run;
+            // a read-ahead done while these were dirty holds the old contents
+            ra_forget(first->drv, first->lba, run);
+            for (uint32_t k = 0; k < run; k++) {
+                flush_list[i + k]->dirty = 0;
+            }
+            stats.dirty -= run;
+        } else {
+            res = RES_ERROR;  // keep them dirty; a later flush retries
+        }
+        i += run;
+    }
+
+    if (stats.dirty == 0) first_dirty_ms = 0;
+    return res;
+}
+
+//------------------------------------------------------------
+// Read-ahead buffer helpers
+//------------------------------------------------------------
+static void ra_discard(bcache_ra *r) {
+    if (r->buf_count > r->buf_used) stats.ra_wasted += r->buf_count - r->buf_used;
+    r->buf_count = 0;
+    r->buf_used  = 0;
+}
+
+// a write makes the buffered copy of those sectors stale
+static void ra_forget(BYTE drv, LBA_t sector, UINT count) {
+    if (drv >= MAX_DRIVES) return;
+    bcache_ra *r = &ra[drv];
+    if (r->buf_count && sector < r->buf_lba + r->buf_count && r->buf_lba < sector + count) {
+        ra_discard(r);
+    }
+}
+
+// copy the front of a request out of the read-ahead buffer; returns sectors served
+static UINT ra_serve(BYTE drv, BYTE *buff, LBA_t sector, UINT count) {
+    if (drv >= MAX_DRIVES) return 0;
+    bcache_ra *r = &ra[drv];
+    if (!r->buf_count || sector < r->buf_lba || sector >= r->buf_lba + r->buf_count) return 0;
+
+    UINT off = sector - r->buf_lba;
+    UINT n = r->buf_count - off;
+    if (n > count) n = count;
+
+    memcpy(buff, r->buf + off * BCACHE_SECTOR, n * BCACHE_SECTOR);
+    r->buf_used += n;
+    if (r->buf_used > r->buf_count) r->buf_used = r->buf_count;
+    stats.ra_hits += n;
+    return n;
+}
+
+// read a run of missing sectors, adding a read-ahead window if this run
+// continues the drive's sequential stream. *sequential tells the caller
+// not to cache the run
+static DRESULT ra_fetch(BYTE drv, BYTE *buff, LBA_t sector, UINT count, int *sequential) {
+    *sequential = 0;
+    if (drv >= MAX_DRIVES) return disk_read_direct(drv, buff, sector, count);
+
+    bcache_ra *r = &ra[drv];
+    int stream = (sector == r->next_lba)
+              || (r->buf_count && sector == r->buf_lba + r->buf_count);
+    r->next_lba = sector + count;
+    if (!stream) {
+        // a seek: FAT and directory sectors belong in the LRU, not here
+        r->window = 0;
+        return disk_read_direct(drv, buff, sector, count);
+    }
+    r->window = r->window ? r->window * 2 : RA_MIN_WINDOW;
+    if (r->window > RA_MAX_WINDOW) r->window = RA_MAX_WINDOW;
+
+    if (count < RA_BUF_SECTORS) {
+        *sequential = 1;
+        if (!r->buf) r->buf = high_alloc(RA_BUF_SECTORS * BCACHE_SECTOR, BCACHE_SECTOR);
+    }
+
+    if (*sequential && r->buf) {
+        UINT extra = RA_BUF_SECTORS - count;
+        if (extra > r->window) extra = r->window;
+
+        ra_discard(r);
+        if (disk_read_direct(drv, r->buf, sector, count + extra) == RES_OK) {
+            memcpy(buff, r->buf, count * BCACHE_SECTOR);
+            r->buf_lba   = sector;
+            r->buf_count = count + extra;
+            r->buf_used  = count;
+            stats.ra_fetched += extra;
+            return RES_OK;
+        }
+        // most likely ran off the end of the disk; read just what was asked
+        r->window = 0;
+    }
+    return disk_read_direct(drv, buff, sector, count);
+}
+
+//------------------------------------------------------------
+// Size the cache from the memory left above the kernel
+//------------------------------------------------------------
+void bcache_init(void) {
+    if (blocks) return;  // high memory can't be given back; keep the first cache
+
+    size_t per_block = BCACHE_SECTOR + sizeof(bcache_block) + sizeof(bcache_block*);
+    size_t want = high_available() / BCACHE_MEM_SHARE / per_block;
+    if (want > BCACHE_MAX_BLOCKS) want = BCACHE_MAX_BLOCKS;
+    if (want < BCACHE_MIN_BLOCKS) return;  // not worth it; run uncached
+
+    uint32_t nbuckets = 1;
+    while (nbuckets < want) nbuckets <<= 1;
+
+    BYTE *data = high_alloc(want * BCACHE_SECTOR, BCACHE_SECTOR);
+    bcache_block *blk = high_alloc(want * sizeof(bcache_block), 8);
+    bcache_block **bkt = high_alloc(nbuckets * sizeof(bcache_block*), 8);
+    if (!data || !blk || !bkt) return;
+
+    // without these the cache still works, but only write-through
+    flush_list = high_alloc(want * sizeof(bcache_block*), 8);
+    flush_buf  = high_alloc(BCACHE_FLUSH_RUN * BCACHE_SECTOR, BCACHE_SECTOR);
+
+    memset(blk, 0, want * sizeof(bcache_block));
+    memset(bkt, 0, nbuckets * sizeof(bcache_block*));
+
+    lru_head = lru_tail = NULL;
+    for (uint32_t i = 0; i < want; i++) {
+        blk[i].data = data + i * BCACHE_SECTOR;
+        lru_push_tail(&blk[i]);
+    }
+
+    buckets   = bkt;
+    hash_mask = nbuckets - 1;
+    nblocks   = want;
+    blocks    = blk;
+
+    memset(&stats, 0, sizeof(stats));
+    stats.blocks = nblocks;
+}
+
+//------------------------------------------------------------
+// Read: serve hits from memory, fetch each run of misses with a
+// single multi-sector disk command
+//------------------------------------------------------------
+DRESULT bcache_read(BYTE drv, BYTE *buff, LBA_t sector, UINT count) {
+    if (!blocks) return disk_read_direct(drv, buff, sector, count);
+
+    UINT i = 0;
+    while (i < count) {
+        bcache_block *b = bcache_lookup(drv, sector + i);
+        if (b) {
+            memcpy(buff + i * BCACHE_SECTOR, b->data, BCACHE_SECTOR);
+            lru_touch(b);
+            stats.hits++;
+            // a cached sector inside the stream doesn't break it
+            if (drv < MAX_DRIVES && ra[drv].next_lba == sector + i) ra[drv].next_lba++;
+            i++;
+            continue;
+        }
+
+        UINT j = i + 1;
+        while (j < count && !bcache_lookup(drv, sector + j)) j++;
+
+        UINT got = ra_serve(drv, buff + i * BCACHE_SECTOR, sector + i, j - i);
+        if (got) {
+            // the rest of the request continues the stream, not a seek
+            i += got;
+            ra[drv].next_lba = sector + i;
+            continue;
+        }
+
+        int sequential;
+        DRESULT res = ra_fetch(drv, buff + i * BCACHE_SECTOR, sector + i, j - i, &sequential);
+        if (res != RES_OK) return res;
+        stats.misses += j - i;
+
+        if (!sequential && j - i <= BCACHE_MAX_INSERT) {
+            for (UINT k = i; k < j; k++) {
+                // can only fail if a dirty victim can't be written; the data is read anyway
+                if (bcache_insert(drv, sector + k, buff + k * BCACHE_SECTOR, 0) < 0) break;
+            }
+        }
+        i = j;
+    }
+
+    return RES_OK;
+}
+
+//------------------------------------------------------------
+// Write. Write-through: the drive is updated first, then the cache.
+// Write-back: small writes only dirty the cache; streams still go
+// straight to the drive
+//------------------------------------------------------------
+DRESULT bcache_write(BYTE drv, const BYTE *buff, LBA_t sector, UINT count) {
+    ra_forget(drv, sector, count);
+
+    if (blocks && writeback && count <= BCACHE_MAX_INSERT) {
+        uint32_t now = get_time_ms();
+        for (UINT k = 0; k < count; k++) {
+            if (bcache_insert(drv, sector + k, buff + k * BCACHE_SECTOR, 1) < 0) {
+                return RES_ERROR;
+            }
+        }
+        stats.absorbed += count;
+        if (!first_dirty_ms) first_dirty_ms = now ? now : 1;
+        last_write_ms = now;
+
+        if (stats.dirty > nblocks / 2 || now - first_dirty_ms >= BCACHE_DIRTY_MS) {
+            return bcache_flush_blocks(BCACHE_ALL_DRIVES);
+        }
+        return RES_OK;
+    }
+
+    stats.write_cmds++;
+    DRESULT res = disk_write_direct(drv, buff, sector, count);
+    if (res == RES_OK) stats.written += count;
+    if (!blocks) return res;
+
+    for (UINT k = 0; k < count; k++) {
+        bcache_block *b = bcache_lookup(drv, sector + k);
+        if (res != RES_OK) {
+            // what reached the platter is unknown now
+            if (b) bcache_drop(b);
+        } else if (b || count <= BCACHE_MAX_INSERT) {
+            // a clean copy can always take the place of a dirty one here
+            bcache_insert(drv, sector + k, buff + k * BCACHE_SECTOR, 0);
+        }
+    }
+    return res;
+}
+
+DRESULT bcache_flush(BYTE drv) {
+    if (!blocks || !stats.dirty) return RES_OK;
+    return bcache_flush_blocks(drv);
+}
+
+void bcache_idle(void) {
+    if (!stats.dirty) return;
+
+    uint32_t now = get_time_ms();
+    if (now - last_write_ms >= BCACHE_IDLE_MS || now - first_dirty_ms >= BCACHE_DIRTY_MS) {
+        last_write_ms = now;  // on failure, retry after another idle period
+        bcache_flush_blocks(BCACHE_ALL_DRIVES);
+    }
+}
+
+int bcache_set_writeback(int enabled) {
+    if (enabled) {
+        if (!blocks || !flush_list || !flush_buf) return -1;
+        writeback = 1;
+        return 0;
+    }
+    writeback = 0;
+    return (bcache_flush(BCACHE_ALL_DRIVES) == RES_OK) ? 0 : -1;
+}
+
+int bcache_writeback_enabled(void) {
+    return writeback;
+}
+
+void bcache_invalidate(BYTE drv) {
+    if (drv < MAX_DRIVES) {
+        ra_discard(&ra[drv]);
+        ra[drv].window = 0;
+    }
+
+    for (uint32_t i = 0; i < nblocks; i++) {
+        if (blocks[i].valid && blocks[i].drv == drv) {
+            bcache_drop(&blocks[i]);
+        }
+    }
+}
+
+void bcache_get_stats(bcache_stats_t *out) {
+    *out = stats;
+}
+
+void bcache_reset_stats(void) {
+    stats.hits = 0;
+    stats.misses = 0;
+    stats.written = 0;
+    stats.write_cmds = 0;
+    stats.absorbed = 0;
+    stats.ra_fetched = 0;
+    stats.ra_hits = 0;
+    stats.ra_wasted = 0;
+}
@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ * 
+ * bcache.h
+ */
+
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "ff.h"
+#include "diskio.h"
+#include <stdint.h>
+
+// Block cache between FatFs (disk_read/disk_write) and the drivers.
+// Sectors are keyed by (logical drive, LBA), found through a hash table
+// and evicted least-recently-used first. Writes go straight through to
+// the drive unless write-back mode is switched on.
+
+#define BCACHE_ALL_DRIVES 0xFF
+
+typedef struct {
+    uint32_t blocks;    // capacity in sectors
+    uint32_t used;      // sectors currently cached
+    uint32_t hits;      // sectors served from the cache
+    uint32_t misses;    // sectors that had to be read from the drive
+    uint32_t dirty;     // sectors waiting to be written back
+    uint32_t absorbed;  // sector writes taken into the cache (write-back)
+    uint32_t written;   // sectors actually written to the drive
+    uint32_t write_cmds; // write commands issued for them
+    uint32_t ra_fetched; // sectors read ahead of a sequential reader
+    uint32_t ra_hits;   // sectors served from the read-ahead buffers
+    uint32_t ra_wasted; // read-ahead sectors thrown away unused
+} bcache_stats_t;
+
+// Size the cache from free memory and allocate it. Safe to call again.
+void bcache_init(void);
+
+// Cached counterparts of disk_read/disk_write (same arguments/results)
+DRESULT bcache_read(BYTE drv, BYTE *buff, LBA_t sector, UINT count);
+DRESULT bcache_write(BYTE drv, const BYTE *buff, LBA_t sector, UINT count);
+
+// Forget every cached sector of a logical drive (e.g. new media).
+// Dirty sectors are discarded; flush first to keep them.
+void bcache_invalidate(BYTE drv);
+
+// Write-back mode. Dirty sectors are written sorted by LBA, in
+// multi-sector runs, by bcache_flush (CTRL_SYNC), by bcache_idle once
+// the disk has gone quiet, or after a timeout.
+int  bcache_set_writeback(int enabled);   // -1 if unavailable / flush failed
+int  bcache_writeback_enabled(void);
+DRESULT bcache_flush(BYTE drv);           // drv or BCACHE_ALL_DRIVES
+void bcache_idle(void);                   // call while waiting for input
+
+void bcache_get_stats(bcache_stats_t *stats);
+void bcache_reset_stats(void);
+
+#endif // BCACHE_H
@@ -22,6 +22,9 @@
 .global boot
 .extern start
 .extern keyboard_handler
+.extern timer_handler
+.extern ata_primary_handler
+.extern ata_secondary_handler
 .extern _bss_start
 .extern _bss_end
 
@@ -87,7 +90,7 @@ zero_bss:
     ret
 
 # -------------------------------
-# remap PIC (keyboard only, IRQ1)
+# remap PIC (timer IRQ0, keyboard IRQ1, cascade IRQ2, IDE IRQ14/15)
 # -------------------------------
 remap_pic:
     movb $0x11, %al
@@ -108,9 +111,9 @@ remap_pic:
     outb %al, $0x21
     outb %al, $0xA1
 
-    movb $0xFD, %al      # keyboard only (IRQ1)
+    movb $0xF8, %al      # timer (IRQ0), keyboard (IRQ1), cascade (IRQ2)
     outb %al, $0x21
-    movb $0xFF, %al
+    movb $0x3F, %al      # primary/secondary IDE (IRQ14/IRQ15)
     outb %al, $0xA1
     ret
 
@@ -131,10 +134,30 @@ setup_idt:
     cmp $256, %ebx
     jne .fill_idt
 
+    mov $timer_handler, %eax
+    mov $0x20, %ebx
+    call set_idt_gate
+
     mov $keyboard_handler, %eax
     mov $0x21, %ebx
     call set_idt_gate
 
+    mov $0x23, %ebx          # IRQ3..IRQ13 stubs from irq.asm
+.fill_irq:
+    mov irq_stub_table - 0x23 * 4(,%ebx,4), %eax
+    call set_idt_gate
+    inc %ebx
+    cmp $0x2E, %ebx
+    jne .fill_irq
+
+    mov $ata_primary_handler, %eax
+    mov $0x2E, %ebx
+    call set_idt_gate
+
+    mov $ata_secondary_handler, %eax
+    mov $0x2F, %ebx
+    call set_idt_gate
+
     mov $double_fault_handler, %eax
     mov $8, %ebx
     call set_idt_gate
@@ -0,0 +1,417 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ *
+ * checksum.c
+ */
+
+#include "checksum.h"
+#include "walk.h"
+#include "disks.h"
+#include "ff.h"
+#include "keyboard.h"
+#include "stdlib.h"
+#include "string.h"
+#include "ctype.h"
+#include "console.h"
+#include "time.h"
+#include <stdint.h>
+
+#define SUM_BUF_KB        128    // one f_read per 128 KB
+#define SUM_MIN_BUF_KB    8
+#define SUM_MANIFEST_MAX  (64 * 1024)
+
+//------------------------------------------------------------
+// CRC-32, slicing-by-8: eight tables let the loop fold in eight
+// bytes per step instead of one
+//------------------------------------------------------------
+static uint32_t crc_table[8][256];
+static int crc_ready;
+
+static void crc32_tables(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ 0xEDB88320u : c >> 1;
+        crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t c = crc_table[t - 1][i];
+            crc_table[t][i] = (c >> 8) ^ crc_table[0][c & 0xFF];
+        }
+    }
+    crc_ready = 1;
+}
+
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+    if (!crc_ready) crc32_tables();
+    crc = ~crc;
+
+    while (len && ((uintptr_t)p & 3)) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xFF];
+        len--;
+    }
+    while (len >= 8) {
+        uint32_t lo = *(const uint32_t *)p ^ crc;
+        uint32_t hi = *(const uint32_t *)(p + 4);
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF]
+            ^ crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24]
+            ^ crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF]
+            ^ crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xFF];
+
+    return ~crc;
+}
+
+//------------------------------------------------------------
+// SHA-256 (FIPS 180-4)
+//------------------------------------------------------------
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t h[8], const uint8_t *p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++, p += 4)
+        w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+    uint32_t e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = k + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g))
+                    + sha256_k[i] + w[i];
+        uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+void sha256_init(sha256_ctx_t *c) {
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(c->h, iv, sizeof(iv));
+    c->used = 0;
+    c->total_lo = c->total_hi = 0;
+}
+
+void sha256_update(sha256_ctx_t *c, const void *data, size_t len) {
+    const uint8_t *p = data;
+    uint32_t lo = c->total_lo + len;
+    if (lo < c->total_lo) c->total_hi++;
+    c->total_lo = lo;
+
+    if (c->used) {
+        size_t n = 64 - c->used;
+        if (n > len) n = len;
+        memcpy(c->block + c->used, p, n);
+        c->used += n;
+        p += n;
+        len -= n;
+        if (c->used < 64) return;
+        sha256_block(c->h, c->block);
+        c->used = 0;
+    }
+    // whole blocks straight from the caller's buffer
+    while (len >= 64) {
+        sha256_block(c->h, p);
+        p += 64;
+        len -= 64;
+    }
+    if (len) {
+        memcpy(c->block, p, len);
+        c->used = len;
+    }
+}
+
+void sha256_final(sha256_ctx_t *c, uint8_t digest[32]) {
+    uint32_t bits_hi = (c->total_hi << 3) | (c->total_lo >> 29);
+    uint32_t bits_lo = c->total_lo << 3;
+
+    c->block[c->used++] = 0x80;
+    if (c->used > 56) {
+        memset(c->block + c->used, 0, 64 - c->used);
+        sha256_block(c->h, c->block);
+        c->used = 0;
+    }
+    memset(c->block + c->used, 0, 56 - c->used);
+    for (int i = 0; i < 4; i++) {
+        c->block[56 + i] = (uint8_t)(bits_hi >> (24 - 8 * i));
+        c->block[60 + i] = (uint8_t)(bits_lo >> (24 - 8 * i));
+    }
+    sha256_block(c->h, c->block);
+
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i]     = (uint8_t)(c->h[i] >> 24);
+        digest[4 * i + 1] = (uint8_t)(c->h[i] >> 16);
+        digest[4 * i + 2] = (uint8_t)(c->h[i] >> 8);
+        digest[4 * i + 3] = (uint8_t)c->h[i];
+    }
+}
+
+//------------------------------------------------------------
+// sum command
+//------------------------------------------------------------
+typedef struct {
+    int algo;
+    BYTE *buf;
+    UINT buf_size;
+    FIL *out;              // manifest being written, or NULL
+    const char *out_path;
+    uint32_t files;
+    uint32_t failed;
+    uint32_t bytes;
+    uint32_t hash_us;      // time spent hashing, the rest is reading
+    int stop;
+} sum_ctx_t;
+
+static void to_hex(const uint8_t *d, int n, char *out) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < n; i++) {
+        out[2 * i]     = digits[d[i] >> 4];
+        out[2 * i + 1] = digits[d[i] & 0x0F];
+    }
+    out[2 * n] = '\0';
+}
+
+// Hash one file into hex (9 or 65 bytes); returns the f_open/f_read result
+static FRESULT sum_file(sum_ctx_t *s, const char *path, char *hex) {
+    FIL fil;
+    FRESULT res = f_open(&fil, path, FA_READ);
+    if (res != FR_OK) return res;
+
+    uint32_t crc = 0;
+    sha256_ctx_t sha;
+    sha256_init(&sha);
+
+    UINT br;
+    while ((res = f_read(&fil, s->buf, s->buf_size, &br)) == FR_OK && br > 0) {
+        uint32_t t = get_time_us();
+        if (s->algo == SUM_CRC32) crc = crc32_update(crc, s->buf, br);
+        else sha256_update(&sha, s->buf, br);
+        s->hash_us += get_time_us() - t;
+        s->bytes += br;
+        if (getch_nb() == 27) {
+            s->stop = 1;
+            res = FR_INT_ERR;
+            break;
+        }
+    }
+    f_close(&fil);
+    if (res != FR_OK) return res;
+
+    if (s->algo == SUM_CRC32) {
+        uint8_t d[4] = { crc >> 24, crc >> 16, crc >> 8, crc };
+        to_hex(d, 4, hex);
+    } else {
+        uint8_t d[32];
+        sha256_final(&sha, d);
+        to_hex(d, 32, hex);
+    }
+    return FR_OK;
+}
+
+static void sum_report(const sum_ctx_t *s, uint32_t ms) {
+    if (ms == 0) ms = 1;
+    uint32_t kb = s->bytes / 1024;
+    uint32_t kbps = (kb < 4000000) ? kb * 1000 / ms : kb / ms * 1000;
+    uint32_t mb10 = kbps * 10 / 1024;
+    uint32_t hash_ms = s->hash_us / 1000;
+    printf("%u file(s), %u KB in %u ms (%u.%u MB/s, %u ms hashing)%s\n",
+           s->files, kb, ms, mb10 / 10, mb10 % 10, hash_ms, s->stop ? " - stopped" : "");
+}
+
+static int sum_begin(sum_ctx_t *s, int algo) {
+    memset(s, 0, sizeof(*s));
+    s->algo = algo;
+    s->buf_size = SUM_BUF_KB * 1024;
+    while (!(s->buf = malloc(s->buf_size)) && s->buf_size > SUM_MIN_BUF_KB * 1024) s->buf_size /= 2;
+    if (!s->buf) {
+        println("Out of memory.");
+        return 0;
+    }
+    return 1;
+}
+
+static void sum_one(sum_ctx_t *s, const char *path) {
+    char hex[65];
+    FRESULT res = sum_file(s, path, hex);
+    if (s->stop) return;
+    s->files++;
+    if (res != FR_OK) {
+        printf("%s: read error (%d)\n", path, res);
+        s->failed++;
+        return;
+    }
+    printf("%s  %s\n", hex, path);
+    if (s->out) {
+        UINT bw;
+        f_write(s->out, hex, strlen(hex), &bw);
+        f_write(s->out, "  ", 2, &bw);
+        f_write(s->out, path, strlen(path), &bw);
+        f_write(s->out, "\r\n", 2, &bw);
+    }
+}
+
+static int sum_visit(const walk_entry_t *e, void *ctx) {
+    sum_ctx_t *s = ctx;
+    // the manifest itself is still being written: leave it out
+    if (!(e->fno->fattrib & AM_DIR) && !(s->out_path && stricmp(e->path, s->out_path) == 0))
+        sum_one(s, e->path);
+    return s->stop ? WALK_STOP : WALK_CONTINUE;
+}
+
+// get_full_path always ends in '/'; files and f_stat want it gone
+static void sum_path(const char *in, char *out) {
+    get_full_path(in, out);
+    size_t len = strlen(out);
+    if (len > 3 && out[len - 1] == '/') out[len - 1] = '\0';
+}
+
+void sum_files(const char *path, int algo, const char *manifest) {
+    sum_ctx_t s;
+    if (!sum_begin(&s, algo)) return;
+
+    char full[MAX_PATH_LEN];
+    sum_path(path, full);
+
+    FIL out;
+    char mpath[MAX_PATH_LEN];
+    if (manifest) {
+        sum_path(manifest, mpath);
+        if (f_open(&out, mpath, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+            printf("%s: cannot create the manifest\n", mpath);
+            free(s.buf);
+            return;
+        }
+        s.out = &out;
+        s.out_path = mpath;
+    }
+
+    uint32_t t0 = get_time_ms();
+    FILINFO fno;
+    if (strlen(full) <= 3 || (f_stat(full, &fno) == FR_OK && (fno.fattrib & AM_DIR))) {
+        walk_filter_t filter = { 0 };
+        filter.attr_clear = AM_DIR;
+        if (walk_tree(full, &filter, 0, sum_visit, &s) != FR_OK && s.files == 0)
+            printf("%s: cannot read the directory\n", full);
+    } else {
+        sum_one(&s, full);
+    }
+    sum_report(&s, get_time_ms() - t0);
+    if (s.failed) printf("%u file(s) could not be read\n", s.failed);
+
+    if (s.out) f_close(s.out);
+    free(s.buf);
+}
+
+void sum_verify(const char *manifest) {
+    char mpath[MAX_PATH_LEN];
+    sum_path(manifest, mpath);
+
+    FIL fil;
+    if (f_open(&fil, mpath, FA_READ) != FR_OK) {
+        printf("%s: cannot open\n", mpath);
+        return;
+    }
+    if (f_size(&fil) >= SUM_MANIFEST_MAX) {
+        printf("%s: manifest larger than %u KB\n", mpath, SUM_MANIFEST_MAX / 1024);
+        f_close(&fil);
+        return;
+    }
+    UINT len = (UINT)f_size(&fil);
+    char *text = malloc(len + 1);
+    UINT br = 0;
+    if (!text || f_read(&fil, text, len, &br) != FR_OK || br != len) {
+        println(text ? "Cannot read the manifest." : "Out of memory.");
+        free(text);
+        f_close(&fil);
+        return;
+    }
+    f_close(&fil);
+    text[len] = '\0';
+
+    sum_ctx_t s;
+    if (!sum_begin(&s, SUM_SHA256)) {
+        free(text);
+        return;
+    }
+
+    uint32_t ok = 0, bad = 0, skipped = 0;
+    uint32_t t0 = get_time_ms();
+    char *line = text;
+    while (*line && !s.stop) {
+        char *next = line;
+        while (*next && *next != '\n') next++;
+        if (*next) *next++ = '\0';
+        size_t ll = strlen(line);
+        if (ll && line[ll - 1] == '\r') line[--ll] = '\0';
+
+        // "<hex> <path>", any blanks between; "*" marks binary mode in
+        // the manifests other tools write
+        char *hex = line;
+        char *p = line;
+        while (isxdigit((unsigned char)*p)) p++;
+        size_t hl = p - hex;
+        if (ll == 0) {
+            line = next;
+            continue;
+        }
+        if ((hl != 8 && hl != 64) || (*p != ' ' && *p != '\t')) {
+            skipped++;
+            line = next;
+            continue;
+        }
+        *p++ = '\0';
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '*') p++;
+
+        char full[MAX_PATH_LEN];
+        sum_path(p, full);
+        s.algo = (hl == 8) ? SUM_CRC32 : SUM_SHA256;
+        char got[65];
+        FRESULT res = sum_file(&s, full, got);
+        if (s.stop) break;
+        s.files++;
+        if (res != FR_OK) {
+            printf("%s: FAILED to read (%d)\n", p, res);
+            bad++;
+        } else if (stricmp(got, hex) != 0) {
+            printf("%s: FAILED\n", p);
+            bad++;
+        } else {
+            printf("%s: OK\n", p);
+            ok++;
+        }
+        line = next;
+    }
+    sum_report(&s, get_time_ms() - t0);
+    printf("%u OK, %u failed", ok, bad);
+    if (skipped) printf(", %u line(s) not understood", skipped);
+    printf("\n");
+
+    free(s.buf);
+    free(text);
+}
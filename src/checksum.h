@@ -0,0 +1,43 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ *
+ * checksum.h
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SUM_CRC32  0x01   // 8 hex digits, the zip/ethernet CRC
+#define SUM_SHA256 0x02   // 64 hex digits
+
+// CRC-32 (reflected, polynomial 0xEDB88320). Start with crc = 0 and
+// feed the previous result back in to continue over several buffers.
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len);
+
+typedef struct {
+    uint32_t h[8];
+    uint8_t block[64];
+    uint32_t used;        // bytes waiting in block
+    uint32_t total_lo;    // message length in bytes
+    uint32_t total_hi;
+} sha256_ctx_t;
+
+void sha256_init(sha256_ctx_t *c);
+void sha256_update(sha256_ctx_t *c, const void *data, size_t len);
+void sha256_final(sha256_ctx_t *c, uint8_t digest[32]);
+
+// Print "<hex>  <path>" for a file, or for every file under a directory,
+// and the total MB/s. With manifest set, the same lines are also written
+// to that file, which sum_verify can check later.
+void sum_files(const char *path, int algo, const char *manifest);
+
+// Check every "<hex>  <path>" line of a manifest; the digest length
+// picks CRC-32 or SHA-256.
+void sum_verify(const char *manifest);
+
+#endif // CHECKSUM_H
@@ -10,11 +10,15 @@
 #include "console.h"
 #include "ctype.h"
 #include "disks.h"
+#include "bcache.h"
+#include "checksum.h"
+#include "diskbench.h"
 #include "ff.h"
 #include "keyboard.h"
 #include "math.h"
 #include "os.h"
 #include "screen.h"
+#include "search.h"
 #include "speaker.h"
 #include "stdlib.h"
 #include "string.h"
@@ -127,6 +131,7 @@ void process_command(const char* command) {
 
     } else if (stricmp(cmd, "reboot") == 0) {
         println("Rebooting the system...");
+        sync_all_drives();
         delay_ms(1000);
         reboot();
 
@@ -137,6 +142,7 @@ void process_command(const char* command) {
 
     } else if (stricmp(cmd, "shutdown") == 0) {
         println("Shutting down the system...");
+        sync_all_drives();
         delay_ms(1000);
         shutdown();
 
@@ -235,20 +241,29 @@ void process_command(const char* command) {
         } else if (stricmp(args[0], "4") == 0) {
             println("Available file / disk commands:");
             println("Drives - List mounted drives.");
-            println("Ls [directory] - List files in cwd or specified dir.");
-            println("Lsr [directory] - List files recursively.");
+            println("Ls [-l] [directory] - List files in cwd or specified dir.");
+            println("Lsr [directory] [pattern] - List files recursively (e.g. *.TXT).");
+            println("Find <pattern> [directory] - Find files by name in a directory tree.");
+            println("Grep [-i] <text> <file|dir> [pattern] - Search files for text.");
             println("Mkdir <directory> - Create a new directory.");
             println("Exists <path> - Check if file or directory exists.");
             println("Filesize <file> - Show size of a file.");
             println("Copy <src> <dst> - Copy a file.");
+            println("Sum [-crc] <file|dir> [-o list] / Sum -c <list> - Checksum, verify.");
             println("Append <file> <text> - Append text to a file.");
             println("New <filename> - Create a new file.");
-            println("Open <filename> - Open a file for reading.");
+            println("Open/Type <filename> [offset] - Show a file a page at a time.");
             println("Del <filename> - Delete a file.");
             println("Rename <oldname> <newname> - Rename a file.");
             println("Format [drive] - Format a drive (warning: destroys data).");
             println("CD <dir> - Change directory.");
             println("DU [drive] - Disk usage (no drive specified will list all drives).");
+            println("Ramdisk <KB> - Create and mount a RAM disk as the next free drive.");
+            println("DMABench [drive] [KB] - Compare PIO and DMA read speed.");
+            println("DiskBench [drive] [MB] [KB] [raw|file] - Throughput, IOPS and latency.");
+            println("Cache [reset|sync|writeback on/off] - Block cache stats and mode.");
+            println("IOStat [secs|hist [pdrv]|reset] - Per-drive I/O counters and latency.");
+            println("DiskInfo - Drive models, capabilities and transfer modes.");
             curs_row += 12;
             update_cursor();
         } else {
@@ -336,24 +351,71 @@ void process_command(const char* command) {
         main_menu_loop();
 
     } else if (stricmp(cmd, "ls") == 0 || stricmp(cmd, "dir") == 0) {
-        if (arg_count == 0) {
-            list_directory_with_paging(NULL);
-        } else if (arg_count == 1) {
-            list_directory_with_paging(args[0]);
+        // usage: ls [-l] [directory]
+        int long_format = (arg_count >= 1 && strcmp(args[0], "-l") == 0);
+        int rest = arg_count - long_format;
+        if (rest == 0) {
+            list_directory_with_paging(NULL, long_format);
+        } else if (rest == 1) {
+            list_directory_with_paging(args[long_format], long_format);
         } else {
-            println("Usage: ls [directory]");
+            println("Usage: ls [-l] [directory]");
         }
 
     } else if (stricmp(cmd, "lsr") == 0) {
-        if (arg_count > 1) {
-            println("Usage: lsr [directory]");
+        if (arg_count > 2) {
+            println("Usage: lsr [directory] [pattern]");
         } else {
-            if (arg_count == 0) {
-                list_directory_recursive(NULL);
+            list_directory_recursive(arg_count >= 1 ? args[0] : NULL,
+                                     arg_count == 2 ? args[1] : NULL);
+        }
+
+    } else if (stricmp(cmd, "find") == 0) {
+        if (arg_count < 1 || arg_count > 2) {
+            println("Usage: find <pattern> [directory]");
+        } else {
+            list_directory_recursive(arg_count == 2 ? args[1] : NULL, args[0]);
+        }
+
+    } else if (stricmp(cmd, "grep") == 0) {
+        // usage: grep [-i] <text> <file|dir> [pattern]
+        int icase = (arg_count >= 1 && stricmp(args[0], "-i") == 0);
+        int rest = arg_count - icase;
+        if (rest < 2 || rest > 3) {
+            println("Usage: grep [-i] <text> <file|dir> [pattern]");
+        } else {
+            grep_files(args[icase], args[icase + 1], rest == 3 ? args[icase + 2] : NULL,
+                       icase ? GREP_ICASE : 0);
+        }
+
+    } else if (stricmp(cmd, "sum") == 0) {
+        // usage: sum [-crc] <file|dir> [-o manifest]  or  sum -c <manifest>
+        int algo = SUM_SHA256;
+        const char *target = NULL;
+        const char *manifest = NULL;
+        int verify = 0;
+        int bad = (arg_count == 0);
+        for (int i = 0; i < arg_count && !bad; i++) {
+            if (stricmp(args[i], "-crc") == 0) {
+                algo = SUM_CRC32;
+            } else if (stricmp(args[i], "-o") == 0 && i + 1 < arg_count) {
+                manifest = args[++i];
+            } else if (stricmp(args[i], "-c") == 0 && i + 1 < arg_count) {
+                manifest = args[++i];
+                verify = 1;
+            } else if (!target && args[i][0] != '-') {
+                target = args[i];
             } else {
-                list_directory_recursive(args[0]);
+                bad = 1;
             }
         }
+        if (bad || (verify && target) || (!verify && !target)) {
+            println("Usage: sum [-crc] <file|dir> [-o manifest] | sum -c <manifest>");
+        } else if (verify) {
+            sum_verify(manifest);
+        } else {
+            sum_files(target, algo, manifest);
+        }
 
     } else if (stricmp(cmd, "mkdir") == 0) {
         if (arg_count != 1) {
@@ -477,32 +539,14 @@ void process_command(const char* command) {
             }
         }
 
-    } else if (stricmp(cmd, "open") == 0) {
-        if (arg_count != 1) {
-            println("Usage: open <filename>");
+    } else if (stricmp(cmd, "open") == 0 || stricmp(cmd, "type") == 0) {
+        // usage: open <filename> [offset]
+        if (arg_count < 1 || arg_count > 2) {
+            println("Usage: open <filename> [offset]");
         } else {
             if (file_exists(args[0])) {
-                print("Opening file: ");
-                println(args[0]);
-                // Read and print in chunks
-                char buf[128];
-                UINT br;
-                FRESULT r;
-                char full[MAX_PATH_LEN];
-                get_full_path(args[0], full);
-                FIL fil;
-                r = f_open(&fil, full, FA_READ);
-                if (r != FR_OK) {
-                    println("Failed to open file.");
-                } else {
-                    while (1) {
-                        r = f_read(&fil, buf, sizeof(buf) - 1, &br);
-                        if (r != FR_OK || br == 0) break;
-                        buf[br] = '\0';
-                        println(buf);
-                    }
-                    f_close(&fil);
-                }
+                DWORD offset = (arg_count == 2) ? (DWORD)strtoul(args[1], NULL, 0) : 0;
+                print_file(args[0], offset);
             } else {
                 println("Error: file not found.");
             }
@@ -600,6 +644,88 @@ void process_command(const char* command) {
         }
       skip_du: ;
 
+    } else if (stricmp(cmd, "ramdisk") == 0) {
+        // usage: ramdisk <KB>
+        if (arg_count != 1 || atoi(args[0]) <= 0) {
+            println("Usage: ramdisk <KB>");
+        } else {
+            create_ramdisk((UINT)atoi(args[0]));
+        }
+
+    } else if (stricmp(cmd, "cache") == 0) {
+        if (arg_count == 0) {
+            print_cache_stats();
+        } else if (arg_count == 1 && stricmp(args[0], "reset") == 0) {
+            bcache_reset_stats();
+            println("Cache counters reset.");
+        } else if (arg_count == 1 && stricmp(args[0], "sync") == 0) {
+            println(sync_all_drives() ? "All drives synced." : "Sync failed on at least one drive.");
+        } else if (arg_count == 2 && stricmp(args[0], "writeback") == 0 && stricmp(args[1], "on") == 0) {
+            if (bcache_set_writeback(1) == 0) {
+                println("Write-back caching enabled.");
+            } else {
+                println("Write-back caching is not available.");
+            }
+        } else if (arg_count == 2 && stricmp(args[0], "writeback") == 0 && stricmp(args[1], "off") == 0) {
+            if (bcache_set_writeback(0) == 0) {
+                println("Write-through caching enabled.");
+            } else {
+                println("Write-through enabled, but some dirty blocks could not be written.");
+            }
+        } else {
+            println("Usage: cache [reset|sync|writeback on/off]");
+        }
+
+    } else if (stricmp(cmd, "diskinfo") == 0) {
+        print_disk_info();
+
+    } else if (stricmp(cmd, "iostat") == 0) {
+        // usage: iostat [secs|hist [pdrv]|reset]
+        if (arg_count == 0) {
+            print_iostat();
+        } else if (arg_count == 1 && stricmp(args[0], "reset") == 0) {
+            disk_reset_stats();
+            println("I/O counters reset.");
+        } else if (arg_count <= 2 && stricmp(args[0], "hist") == 0) {
+            print_iostat_histogram((arg_count == 2) ? atoi(args[1]) : -1);
+        } else if (arg_count == 1 && atoi(args[0]) > 0) {
+            iostat_watch((uint32_t)atoi(args[0]) * 1000);
+        } else {
+            println("Usage: iostat [secs|hist [pdrv]|reset]");
+        }
+
+    } else if (stricmp(cmd, "diskbench") == 0) {
+        // usage: diskbench [drive] [MB] [KB per sequential request] [raw|file]
+        const char *drive_spec = (arg_count > 0) ? args[0] : NULL;
+        int mb = (arg_count > 1) ? atoi(args[1]) : 16;
+        int kb = (arg_count > 2) ? atoi(args[2]) : 64;
+        int what = DISKBENCH_RAW | DISKBENCH_FILE;
+        if (arg_count > 3 && stricmp(args[3], "raw") == 0) what = DISKBENCH_RAW;
+        else if (arg_count > 3 && stricmp(args[3], "file") == 0) what = DISKBENCH_FILE;
+        else if (arg_count > 3) what = 0;
+
+        if (arg_count > 4 || what == 0) {
+            println("Usage: diskbench [drive] [MB] [KB] [raw|file]");
+        } else if (mb <= 0 || mb > 1024 || kb <= 0 || kb > 256) {
+            println("Size must be 1-1024 MB, requests 1-256 KB.");
+        } else {
+            disk_benchmark(drive_spec, (UINT)mb, (UINT)kb, what);
+        }
+
+    } else if (stricmp(cmd, "dmabench") == 0) {
+        // usage: dmabench [drive] [KB]
+        if (arg_count > 2) {
+            println("Usage: dmabench [drive] [KB]");
+        } else {
+            const char *drive_spec = (arg_count > 0) ? args[0] : NULL;
+            int kb = (arg_count > 1) ? atoi(args[1]) : 1024;
+            if (kb <= 0) {
+                println("Size must be a positive number of KB.");
+            } else {
+                ata_benchmark(drive_spec, (UINT)kb * 2);
+            }
+        }
+
     } else if (stricmp(cmd, "") == 0) {
         // No-op for empty command
 
@@ -87,6 +87,61 @@ void print(const char *str)
     }
 }
 
+/* Write a block of raw text (e.g. file contents) straight to video memory.
+   '\r' is dropped, tabs go to the next multiple of 8 and other control
+   bytes show as '.'. The hardware cursor is moved once, at the end.
+   If lines_left is given, stop after that many line breaks (newlines or
+   wraps), counting it down. Returns the number of bytes consumed. */
+size_t console_write(const char *buf, size_t len, size_t *lines_left)
+{
+    size_t i;
+    for (i = 0; i < len; i++)
+    {
+        if (lines_left && *lines_left == 0)
+            break;
+
+        unsigned char c = (unsigned char)buf[i];
+        if (c == '\r')
+            continue;
+        if (c == '\n')
+        {
+            newline();
+            if (lines_left) (*lines_left)--;
+            continue;
+        }
+
+        size_t width = 1;
+        if (c == '\t')
+        {
+            width = 8 - (col % 8);
+            c = ' ';
+        }
+        else if (c < ' ' || c == 0x7F)
+        {
+            c = '.';
+        }
+
+        while (width--)
+        {
+            if (col >= NUM_COLS)
+            {
+                newline();
+                if (lines_left) (*lines_left)--;
+            }
+            buffer[col + NUM_COLS * row] = (struct Char){
+                .character = c,
+                .color = default_color,
+            };
+            col++;
+        }
+    }
+
+    curs_row = row;
+    curs_col = col < NUM_COLS ? col : NUM_COLS - 1;
+    update_cursor();
+    return i;
+}
+
 /* Print a string and a new line */
 void println(const char *str)
 {
@@ -42,6 +42,7 @@ void newline();
 void printc(char c);
 void print(const char *str);
 void println(const char *str);
+size_t console_write(const char *buf, size_t len, size_t *lines_left);
 void set_color(uint8_t fg, uint8_t bg);
 void print_hex(uintptr_t val);
 
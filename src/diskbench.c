@@ -0,0 +1,300 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ *
+ * diskbench.c
+ */
+
+#include "diskbench.h"
+#include "diskio.h"
+#include "disks.h"
+#include "stdlib.h"
+#include "string.h"
+#include "console.h"
+#include "time.h"
+#include <stdint.h>
+
+#define BENCH_RANDOM_KB    4
+#define BENCH_MAX_SAMPLES  4096   // per-request latencies kept for percentiles
+#define BENCH_FILE_NAME    "BENCH.TMP"
+
+typedef struct {
+    const char *name;
+    uint32_t requests;
+    uint32_t bytes;
+    uint32_t ms;                  // wall time of the whole test
+    uint32_t *lat;                // per-request microseconds
+    uint32_t nlat;
+} bench_result_t;
+
+static uint32_t bench_seed;
+
+// small LCG: the same sequence every run, so runs compare
+static uint32_t bench_rand(void) {
+    bench_seed = bench_seed * 1103515245u + 12345u;
+    return bench_seed >> 8;
+}
+
+static void bench_begin(bench_result_t *r, const char *name, uint32_t *lat) {
+    memset(r, 0, sizeof(*r));
+    r->name = name;
+    r->lat = lat;
+    bench_seed = 0x5EED;
+}
+
+static void bench_sample(bench_result_t *r, uint32_t start_us, uint32_t bytes) {
+    uint32_t us = get_time_us() - start_us;
+    if (r->nlat < BENCH_MAX_SAMPLES) r->lat[r->nlat++] = us;
+    r->requests++;
+    r->bytes += bytes;
+}
+
+// shell sort; a few thousand samples at most
+static void sort_u32(uint32_t *a, uint32_t n) {
+    for (uint32_t gap = n / 2; gap > 0; gap /= 2) {
+        for (uint32_t i = gap; i < n; i++) {
+            uint32_t v = a[i];
+            uint32_t j = i;
+            while (j >= gap && a[j - gap] > v) {
+                a[j] = a[j - gap];
+                j -= gap;
+            }
+            a[j] = v;
+        }
+    }
+}
+
+static uint32_t percentile(const uint32_t *sorted, uint32_t n, uint32_t pct) {
+    if (n == 0) return 0;
+    uint32_t i = (n * pct + 99) / 100;
+    return sorted[(i == 0) ? 0 : i - 1];
+}
+
+static void bench_report(bench_result_t *r) {
+    if (r->ms == 0) r->ms = 1;
+    sort_u32(r->lat, r->nlat);
+
+    // KB/s, then MB/s with one decimal
+    uint32_t kbps = (r->bytes / 1024 < 4000000) ? r->bytes / 1024 * 1000 / r->ms
+                                                 : r->bytes / 1024 / r->ms * 1000;
+    uint32_t mb10 = kbps * 10 / 1024;
+    uint32_t iops = (r->requests < 4000000) ? r->requests * 1000 / r->ms : r->requests / r->ms * 1000;
+
+    printf("%-12s %5u.%u %7u %8u %8u %8u %8u\n", r->name, mb10 / 10, mb10 % 10, iops,
+           percentile(r->lat, r->nlat, 50), percentile(r->lat, r->nlat, 90),
+           percentile(r->lat, r->nlat, 99), r->nlat ? r->lat[r->nlat - 1] : 0);
+}
+
+static void bench_failed(const char *name, const char *why) {
+    printf("%-12s %s\n", name, why);
+}
+
+//------------------------------------------------------------
+// Raw drive: disk_read_direct/disk_write_direct on a window in
+// the middle of the drive
+//------------------------------------------------------------
+static void bench_raw(BYTE drv, UINT mb, UINT request_kb, BYTE *buf, uint32_t *lat) {
+    LBA_t disk_sectors = 0;
+    if (disk_ioctl(drv, GET_SECTOR_COUNT, &disk_sectors) != RES_OK || disk_sectors < 64) {
+        println("raw: cannot get the drive size");
+        return;
+    }
+
+    uint32_t area = (uint32_t)mb * 2048;
+    if (area > disk_sectors / 2) area = (uint32_t)(disk_sectors / 2) & ~7u;
+    LBA_t base = (disk_sectors / 4) & ~(LBA_t)7;
+    UINT per = request_kb * 2;
+    UINT rnd = BENCH_RANDOM_KB * 2;
+    uint32_t rnd_slots = area / rnd;
+    uint32_t rnd_count = (rnd_slots < BENCH_MAX_SAMPLES) ? rnd_slots : BENCH_MAX_SAMPLES;
+    int writable = !(disk_status(drv) & STA_PROTECT);
+    bench_result_t r;
+
+    printf("raw: %u KB at sector %u\n", area / 2, (uint32_t)base);
+
+    // anything still dirty in the cache must be on the disk before we rewrite it
+    disk_ioctl(drv, CTRL_SYNC, 0);
+
+    bench_begin(&r, "seq read", lat);
+    uint32_t t0 = get_time_ms();
+    for (uint32_t done = 0; done + per <= area; done += per) {
+        uint32_t s = get_time_us();
+        if (disk_read_direct(drv, buf, base + done, per) != RES_OK) break;
+        bench_sample(&r, s, per * 512);
+    }
+    r.ms = get_time_ms() - t0;
+    bench_report(&r);
+
+    // writes put back what was read, so only the rewrite itself is timed
+    if (writable) {
+        bench_begin(&r, "seq write", lat);
+        uint32_t busy_us = 0;
+        for (uint32_t done = 0; done + per <= area; done += per) {
+            if (disk_read_direct(drv, buf, base + done, per) != RES_OK) break;
+            uint32_t s = get_time_us();
+            if (disk_write_direct(drv, buf, base + done, per) != RES_OK) break;
+            bench_sample(&r, s, per * 512);
+            busy_us += get_time_us() - s;
+        }
+        r.ms = busy_us / 1000;
+        bench_report(&r);
+    } else {
+        bench_failed("seq write", "skipped: write protected");
+    }
+
+    bench_begin(&r, "4K rnd read", lat);
+    t0 = get_time_ms();
+    for (uint32_t i = 0; i < rnd_count; i++) {
+        LBA_t lba = base + (bench_rand() % rnd_slots) * rnd;
+        uint32_t s = get_time_us();
+        if (disk_read_direct(drv, buf, lba, rnd) != RES_OK) break;
+        bench_sample(&r, s, rnd * 512);
+    }
+    r.ms = get_time_ms() - t0;
+    bench_report(&r);
+
+    if (writable) {
+        bench_begin(&r, "4K rnd write", lat);
+        uint32_t busy_us = 0;
+        for (uint32_t i = 0; i < rnd_count; i++) {
+            LBA_t lba = base + (bench_rand() % rnd_slots) * rnd;
+            if (disk_read_direct(drv, buf, lba, rnd) != RES_OK) break;
+            uint32_t s = get_time_us();
+            if (disk_write_direct(drv, buf, lba, rnd) != RES_OK) break;
+            bench_sample(&r, s, rnd * 512);
+            busy_us += get_time_us() - s;
+        }
+        r.ms = busy_us / 1000;
+        bench_report(&r);
+    } else {
+        bench_failed("4K rnd write", "skipped: write protected");
+    }
+
+    disk_ioctl(drv, CTRL_SYNC, 0);
+}
+
+//------------------------------------------------------------
+// FatFs: the same tests on a temporary file in the root directory
+//------------------------------------------------------------
+static void bench_file(BYTE drv, UINT mb, UINT request_kb, BYTE *buf, uint32_t *lat) {
+    char path[16];
+    snprintf(path, sizeof(path), "%d:/%s", drv, BENCH_FILE_NAME);
+
+    uint32_t size = (uint32_t)mb * 1024 * 1024;
+    UINT per = request_kb * 1024;
+    UINT rnd = BENCH_RANDOM_KB * 1024;
+    uint32_t rnd_slots = size / rnd;
+    uint32_t rnd_count = (rnd_slots < BENCH_MAX_SAMPLES) ? rnd_slots : BENCH_MAX_SAMPLES;
+    bench_result_t r;
+    FIL fil;
+    UINT bw;
+
+    printf("file: %s, %u KB\n", path, size / 1024);
+    for (UINT i = 0; i < per; i++) buf[i] = (BYTE)(i * 7);
+
+    // sequential write, including the final f_sync
+    if (f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+        bench_failed("seq write", "cannot create the file");
+        return;
+    }
+    bench_begin(&r, "seq write", lat);
+    uint32_t t0 = get_time_ms();
+    for (uint32_t done = 0; done + per <= size; done += per) {
+        uint32_t s = get_time_us();
+        if (f_write(&fil, buf, per, &bw) != FR_OK || bw != per) break;
+        bench_sample(&r, s, per);
+    }
+    f_sync(&fil);
+    r.ms = get_time_ms() - t0;
+    f_close(&fil);
+    if (r.bytes < size / per * per) {
+        bench_failed("seq write", "write failed (disk full?)");
+        f_unlink(path);
+        return;
+    }
+    bench_report(&r);
+
+    if (f_open(&fil, path, FA_READ | FA_WRITE) != FR_OK) {
+        bench_failed("seq read", "cannot open the file");
+        f_unlink(path);
+        return;
+    }
+
+    bench_begin(&r, "seq read", lat);
+    t0 = get_time_ms();
+    for (uint32_t done = 0; done + per <= size; done += per) {
+        uint32_t s = get_time_us();
+        if (f_read(&fil, buf, per, &bw) != FR_OK || bw != per) break;
+        bench_sample(&r, s, per);
+    }
+    r.ms = get_time_ms() - t0;
+    bench_report(&r);
+
+    // random requests are timed with their f_lseek, which the link map
+    // turns into a table lookup instead of a walk along the FAT
+    if (file_fastseek(&fil) != FR_OK) println("file: no fast seek, seeks walk the FAT");
+
+    bench_begin(&r, "4K rnd read", lat);
+    t0 = get_time_ms();
+    for (uint32_t i = 0; i < rnd_count; i++) {
+        uint32_t s = get_time_us();
+        if (f_lseek(&fil, (FSIZE_t)(bench_rand() % rnd_slots) * rnd) != FR_OK) break;
+        if (f_read(&fil, buf, rnd, &bw) != FR_OK || bw != rnd) break;
+        bench_sample(&r, s, rnd);
+    }
+    r.ms = get_time_ms() - t0;
+    bench_report(&r);
+
+    bench_begin(&r, "4K rnd write", lat);
+    t0 = get_time_ms();
+    for (uint32_t i = 0; i < rnd_count; i++) {
+        uint32_t s = get_time_us();
+        if (f_lseek(&fil, (FSIZE_t)(bench_rand() % rnd_slots) * rnd) != FR_OK) break;
+        if (f_write(&fil, buf, rnd, &bw) != FR_OK || bw != rnd) break;
+        bench_sample(&r, s, rnd);
+    }
+    f_sync(&fil);
+    r.ms = get_time_ms() - t0;
+    bench_report(&r);
+
+    file_fastseek_release(&fil);
+    f_close(&fil);
+    f_unlink(path);
+}
+
+void disk_benchmark(const char *drive_spec, UINT mb, UINT request_kb, int what) {
+    int drv = current_drive;
+    if (drive_spec
+        && drive_spec[0] >= '0'
+        && drive_spec[0] <= '0' + (MAX_LOGICAL_DRIVES - 1)
+        && drive_spec[1] == ':') {
+        drv = drive_spec[0] - '0';
+    }
+
+    if (disk_status((BYTE)drv) & STA_NOINIT) {
+        println("Drive not present.");
+        return;
+    }
+    if (request_kb < BENCH_RANDOM_KB) request_kb = BENCH_RANDOM_KB;
+
+    BYTE *buf = malloc(request_kb * 1024);
+    uint32_t *lat = malloc(BENCH_MAX_SAMPLES * sizeof(uint32_t));
+    if (!buf || !lat) {
+        println("Out of memory.");
+        free(buf);
+        free(lat);
+        return;
+    }
+
+    printf("Drive %d:, %u MB, %u KB sequential requests, one request in flight\n",
+           drv, mb, request_kb);
+    printf("%-12s %7s %7s %8s %8s %8s %8s\n", "test", "MB/s", "IOPS",
+           "p50 us", "p90 us", "p99 us", "max us");
+
+    if (what & DISKBENCH_RAW)  bench_raw((BYTE)drv, mb, request_kb, buf, lat);
+    if (what & DISKBENCH_FILE) bench_file((BYTE)drv, mb, request_kb, buf, lat);
+
+    free(lat);
+    free(buf);
+}
@@ -0,0 +1,24 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ *
+ * diskbench.h
+ */
+
+#ifndef DISKBENCH_H
+#define DISKBENCH_H
+
+#include "ff.h"
+#include <stdint.h>
+
+#define DISKBENCH_RAW  0x01   // sectors of the drive, below the block cache
+#define DISKBENCH_FILE 0x02   // a temporary file, through FatFs and the cache
+
+// Sequential read/write in request_kb requests and 4 KB random read/write
+// over mb MB of drive_spec ("0:".."3:", NULL = current drive). Prints
+// MB/s, IOPS and latency percentiles per test. Raw write tests write back
+// the data they just read, so the drive's contents are left as they were.
+void disk_benchmark(const char *drive_spec, UINT mb, UINT request_kb, int what);
+
+#endif // DISKBENCH_H
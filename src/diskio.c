@@ -9,8 +9,14 @@
 #include "diskio.h"  /* declarations of disk functions */
 #include "port.h"    /* port specific functions: inb, outb, inw, outw, delay_ms */
 #include <stdint.h>
-#include <stdio.h>   /* for debug printing, if available */
 #include "time.h"    /* for prototype of delay_ms if needed */
+#include "pci.h"     /* locating the IDE controller for bus-master DMA */
+#include "bcache.h"  /* block cache sitting in front of the drivers */
+#include "ahci.h"    /* SATA disks on an AHCI controller */
+#include "virtio_blk.h"  /* paravirtual disks under QEMU/KVM */
+#include "ramdisk.h" /* memory-backed disks */
+#include "stdlib.h"  /* snprintf for drive names */
+#include "string.h"  /* memset for the statistics */
 
 /* constants for channels and drives */
 
@@ -25,19 +31,114 @@ static const uint8_t ATA_DRIVE_SEL[2] = { 0xE0, 0xF0 };  /* 0: master (bit7=1,bi
 #define ATA_CMD_IDENTIFY 0xEC
 #define ATA_CMD_READ     0x20
 #define ATA_CMD_WRITE    0x30
+#define ATA_CMD_READ_DMA  0xC8
+#define ATA_CMD_WRITE_DMA 0xCA
+#define ATA_CMD_READ_EXT      0x24  /* LBA48 variants */
+#define ATA_CMD_WRITE_EXT     0x34
+#define ATA_CMD_READ_DMA_EXT  0x25
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_CMD_FLUSH_CACHE     0xE7
+#define ATA_CMD_FLUSH_CACHE_EXT 0xEA
+#define ATA_CMD_READ_MULTIPLE      0xC4  /* PIO, one interrupt per block of sectors */
+#define ATA_CMD_WRITE_MULTIPLE     0xC5
+#define ATA_CMD_READ_MULTIPLE_EXT  0x29
+#define ATA_CMD_WRITE_MULTIPLE_EXT 0x39
+#define ATA_CMD_SET_MULTIPLE       0xC6
+#define ATA_CMD_SET_FEATURES       0xEF
+
+/* SET FEATURES subcommands (features register) */
+#define ATA_FEAT_WCACHE_ON   0x02
+#define ATA_FEAT_XFER_MODE   0x03  /* sector count register holds the mode */
+
+/* transfer mode values for ATA_FEAT_XFER_MODE */
+#define ATA_XFER_PIO   0x08
+#define ATA_XFER_MDMA  0x20
+#define ATA_XFER_UDMA  0x40
 
 /* status flags */
 #define ATA_STATUS_BUSY  0x80
+#define ATA_STATUS_DF    0x20
 #define ATA_STATUS_DRQ   0x08
 #define ATA_STATUS_ERR   0x01
 
+/* error register bits */
+#define ATA_ERROR_ABRT   0x04
+
+/* sector count register is 8 bits wide; 0 means 256 */
+#define ATA_MAX_SECTORS_PER_CMD 256
+
+/* LBA48 commands take a 16-bit count; 0 means 65536 */
+#define ATA_MAX_SECTORS_PER_EXT_CMD 65536
+
+/* highest sector a 28-bit command can address, plus one */
+#define ATA_LBA28_LIMIT 0x10000000ULL
+
+/* timeouts (ms) measured against the PIT tick, not loop iterations */
+#define ATA_TIMEOUT_MS          5000  /* data transfer / command completion */
+#define ATA_IDENTIFY_TIMEOUT_MS 100   /* probing a position that may be empty */
+#define ATA_SPINUP_TIMEOUT_MS   10000 /* a drive may stay BSY this long after power-on */
+#define ATA_FLUSH_TIMEOUT_MS    30000 /* FLUSH CACHE may empty a large write cache */
+
+/* IRQ completion state per channel (0 = primary/IRQ14, 1 = secondary/IRQ15).
+   set by irq_ata_handler_c, consumed by ata_wait_irq */
+static volatile uint8_t ata_irq_fired[2]  = { 0, 0 };
+static volatile uint8_t ata_irq_status[2] = { 0, 0 };
+
+/* bus-master IDE registers, relative to a channel's BMIDE base */
+#define BM_COMMAND       0x00
+#define BM_STATUS        0x02
+#define BM_PRDT          0x04
+#define BM_CMD_START     0x01
+#define BM_CMD_READ      0x08  /* device -> memory */
+#define BM_STATUS_ERR    0x02
+#define BM_STATUS_IRQ    0x04
+
+/* physical region descriptor: one contiguous chunk of a DMA buffer */
+typedef struct {
+    uint32_t addr;
+    uint16_t bytes;   /* 0 means 64 KiB */
+    uint16_t flags;
+} __attribute__((packed)) ata_prd_t;
+
+#define ATA_PRD_ENTRIES  512
+#define ATA_PRD_EOT      0x8000
+#define ATA_DMA_UNUSABLE (-2)
+
+/* a full table moves this many sectors, whatever the buffer alignment */
+#define ATA_DMA_MAX_SECTORS ((ATA_PRD_ENTRIES - 1) * 128)
+
+/* one PRD table per channel, aligned to its own size so it can never
+   straddle a 64 KiB boundary */
+static ata_prd_t ata_prdt[2][ATA_PRD_ENTRIES] __attribute__((aligned(ATA_PRD_ENTRIES * 8)));
+
+/* bus-master base per channel (0 = no DMA on that channel) */
+static uint16_t ata_bm_base[2] = { 0, 0 };
+
+/* drives whose IDENTIFY data advertises DMA (physical indices) */
+static uint8_t ata_dma_capable[ATA_MAX_DRIVES] = { 0, 0, 0, 0 };
+
+/* global switch, so PIO and DMA can be compared on the same drive */
+static int ata_dma_enabled = 1;
+
 /* array to remember which drives are actually present (physical indices) */
-uint8_t drive_present[MAX_DRIVES] = { 0, 0, 0, 0 };
+uint8_t drive_present[MAX_PHYS_DRIVES] = { 0 };
+
+/* store total sectors for each ATA drive (physical indices) */
+static uint64_t total_sectors[ATA_MAX_DRIVES]  = { 0, 0, 0, 0 };
+
+/* drives that implement the 48-bit feature set (physical indices) */
+static uint8_t ata_lba48[ATA_MAX_DRIVES] = { 0, 0, 0, 0 };
+
+/* what IDENTIFY reported and what SET MULTIPLE / SET FEATURES got us */
+static ata_info_t ata_info[ATA_MAX_DRIVES];
 
-/* store total sectors for each drive (physical indices) */
-static DWORD total_sectors[MAX_DRIVES]  = { 0, 0, 0, 0 };
+/* which driver handles each physical drive, and its unit number there.
+   0..3 are always the legacy ATA positions; other controllers' drives
+   are registered behind them by disk_register */
+static BYTE phys_type[MAX_PHYS_DRIVES] = { DISK_TYPE_ATA, DISK_TYPE_ATA, DISK_TYPE_ATA, DISK_TYPE_ATA };
+static BYTE phys_unit[MAX_PHYS_DRIVES] = { 0, 1, 2, 3 };
 
-/* mapping from logical (0..MAX_DRIVES-1) to physical (0..3) */
+/* mapping from logical (0..MAX_DRIVES-1) to physical (0..MAX_PHYS_DRIVES-1) */
 extern BYTE logical_to_physical[MAX_DRIVES];
 
 /*-----------------------------------------------------------------------*/
@@ -57,22 +158,25 @@ static inline void ata_send_command(uint16_t io_base, uint8_t cmd) {
     outb(io_base + 7, cmd);
 }
 
-/* wait until BSY clears or timeout, checking alternate status port */
-static int wait_for_bsy_clear(uint16_t ctrl_base) {
+/* wait until BSY clears or timeout_ms elapses, checking alternate status port */
+static int wait_for_bsy_clear(uint16_t ctrl_base, uint32_t timeout_ms) {
     uint8_t status;
-    for (int t = 0; t < 100000; t++) {
+    uint32_t start = get_time_ms();
+    do {
         status = ata_read_alt_status(ctrl_base);
         if (!(status & ATA_STATUS_BUSY)) {
             return status;  /* return final status */
         }
-    }
+    } while (get_time_ms() - start < timeout_ms);
+    disk_note_timeout();
     return 0xFF;  /* timed out */
 }
 
-/* wait until DRQ sets or timeout */
-static int wait_for_drq_set(uint16_t io_base) {
+/* wait until DRQ sets or timeout_ms elapses */
+static int wait_for_drq_set(uint16_t io_base, uint32_t timeout_ms) {
     uint8_t status;
-    for (int t = 0; t < 100000; t++) {
+    uint32_t start = get_time_ms();
+    do {
         status = ata_read_status(io_base);
         if (status & ATA_STATUS_DRQ) {
             return 0;  /* DRQ is set */
@@ -80,10 +184,59 @@ static int wait_for_drq_set(uint16_t io_base) {
         if (status & ATA_STATUS_ERR) {
             return -1; /* error */
         }
-    }
+    } while (get_time_ms() - start < timeout_ms);
     return -1; /* timed out */
 }
 
+/*-----------------------------------------------------------------------*/
+/* IRQ14/IRQ15 completion                                                */
+/*-----------------------------------------------------------------------*/
+
+/* called from ata_primary_handler/ata_secondary_handler in irq.asm */
+void irq_ata_handler_c(uint32_t channel) {
+    channel &= 0x01;
+    /* reading the regular status register acknowledges the drive's INTRQ */
+    ata_irq_status[channel] = ata_read_status(ATA_IO_BASES[channel]);
+    ata_irq_fired[channel] = 1;
+}
+
+/* forget any interrupt left over from a previous command */
+static inline void ata_irq_clear(uint8_t channel) {
+    asm volatile ("cli");
+    ata_irq_fired[channel] = 0;
+    asm volatile ("sti");
+}
+
+/* sleep (HLT) until the channel raises its IRQ or timeout_ms elapses.
+   returns the status latched by the handler, or -1 on timeout */
+static int ata_wait_irq(uint8_t channel, uint16_t ctrl_base, uint32_t timeout_ms) {
+    uint32_t start = get_time_ms();
+
+    for (;;) {
+        /* check-then-halt must be atomic, or an IRQ landing in between
+           leaves us asleep until the next timer tick */
+        asm volatile ("cli");
+        if (ata_irq_fired[channel]) {
+            ata_irq_fired[channel] = 0;
+            asm volatile ("sti");
+            return ata_irq_status[channel];
+        }
+        if (get_time_ms() - start >= timeout_ms) {
+            asm volatile ("sti");
+            break;
+        }
+        asm volatile ("sti; hlt");  /* sti only takes effect after hlt */
+    }
+
+    /* no interrupt arrived; if the drive finished anyway, treat it as a lost IRQ */
+    uint8_t status = ata_read_alt_status(ctrl_base);
+    if (!(status & ATA_STATUS_BUSY) && status != 0xFF) {
+        return ata_read_status(ATA_IO_BASES[channel]);
+    }
+    disk_note_timeout();
+    return -1;
+}
+
 /* read 256 words (512 bytes) from data port */
 static void ata_read_data(uint16_t io_base, uint16_t *buf) {
     for (int i = 0; i < 256; i++) {
@@ -98,6 +251,77 @@ static void ata_write_data(uint16_t io_base, const uint16_t *buf) {
     }
 }
 
+/* ~400ns settle time: four reads of the alternate status port */
+static inline void ata_delay_400ns(uint16_t ctrl_base) {
+    for (int i = 0; i < 4; i++) {
+        ata_read_alt_status(ctrl_base);
+    }
+}
+
+/* wait for the next data block of a command: BSY clear, no error, DRQ set */
+static int ata_wait_data(uint16_t io_base, uint16_t ctrl_base) {
+    uint8_t status = wait_for_bsy_clear(ctrl_base, ATA_TIMEOUT_MS);
+    if (status == 0xFF || (status & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+        return -1;
+    }
+    if (status & ATA_STATUS_DRQ) {
+        return 0;
+    }
+    return wait_for_drq_set(io_base, ATA_TIMEOUT_MS);
+}
+
+/* sleep until the drive interrupts for the next data block (or completion)
+   and check the latched status. want_drq: a data block must follow */
+static int ata_wait_block(uint8_t channel, uint16_t ctrl_base, int want_drq) {
+    int status = ata_wait_irq(channel, ctrl_base, ATA_TIMEOUT_MS);
+    if (status < 0 || (status & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+        return -1;
+    }
+    if (want_drq && !(status & ATA_STATUS_DRQ)) {
+        return -1;
+    }
+    return 0;
+}
+
+/* program the task file for a transfer of n sectors and send the command.
+   lba48 = 0: 28-bit LBA, n = 1..256.  lba48 = 1: 48-bit LBA, n = 1..65536.
+   returns 0 once the command is issued, -1 on timeout */
+static int ata_issue_rw(uint16_t io_base, uint16_t ctrl_base, uint8_t drive_sel,
+                        uint64_t lba, UINT n, uint8_t cmd, int lba48) {
+    /* select drive; 28-bit commands carry LBA bits 24..27 in the head nibble */
+    if (lba48) {
+        outb(io_base + 6, drive_sel);
+    } else {
+        outb(io_base + 6, drive_sel | (uint8_t)((lba >> 24) & 0x0F));
+    }
+    ata_delay_400ns(ctrl_base);
+
+    /* task file may only be written while the selected drive is idle */
+    if (wait_for_bsy_clear(ctrl_base, ATA_TIMEOUT_MS) == 0xFF) {
+        return -1;
+    }
+
+    if (lba48) {
+        /* high ("previous") bytes first: each register is a two-deep FIFO */
+        outb(io_base + 2, (uint8_t)((n >> 8) & 0xFF));   /* count bits 8..15 (65536 -> 0) */
+        outb(io_base + 3, (uint8_t)((lba >> 24) & 0xFF)); /* LBA bits 24..31 */
+        outb(io_base + 4, (uint8_t)((lba >> 32) & 0xFF)); /* LBA bits 32..39 */
+        outb(io_base + 5, (uint8_t)((lba >> 40) & 0xFF)); /* LBA bits 40..47 */
+    }
+
+    outb(io_base + 2, (uint8_t)n);                        /* sector count (256 -> 0) */
+    outb(io_base + 3, (uint8_t)(lba & 0xFF));             /* LBA bits 0..7 */
+    outb(io_base + 4, (uint8_t)((lba >> 8) & 0xFF));      /* LBA bits 8..15 */
+    outb(io_base + 5, (uint8_t)((lba >> 16) & 0xFF));     /* LBA bits 16..23 */
+
+    ata_send_command(io_base, cmd);
+    ata_delay_400ns(ctrl_base);
+    return 0;
+}
+
+/* channel (0 = primary, 1 = secondary) of a physical pdrv (0..3) */
+#define ATA_CHANNEL(pdrv) (((pdrv) / 2) & 0x01)
+
 /*-----------------------------------------------------------------------*/
 /* translate physical pdrv (0..3) to channel and drive select bits       */
 /*-----------------------------------------------------------------------*/
@@ -119,209 +343,569 @@ static void pdrv_to_ata(uint8_t pdrv, uint16_t *io_base, uint16_t *ctrl_base, ui
 #endif
 
 /*-----------------------------------------------------------------------*/
-/* Physical drive initialize (0..3) – returns STA_NOINIT or 0           */
+/* Drive probing. Each position goes through a small state machine so   */
+/* that both channels can wait out spin-up and IDENTIFY at the same time */
 /*-----------------------------------------------------------------------*/
-static DSTATUS phys_disk_initialize(BYTE pdrv) {
-    if (pdrv >= MAX_DRIVES) return STA_NOINIT;
+#define ATA_PROBE_SPINUP   0   /* waiting for BSY to clear before IDENTIFY */
+#define ATA_PROBE_IDENTIFY 1   /* IDENTIFY sent, waiting for its data */
+#define ATA_PROBE_DONE     2   /* finished; drive_present[] holds the result */
+
+typedef struct {
+    BYTE     pdrv;
+    uint8_t  state;
+    uint32_t since;            /* get_time_ms() when the state was entered */
+} ata_probe_t;
+
+/* IDENTIFY strings are space padded with the bytes of each word swapped */
+static void ata_identify_string(const uint16_t *id, int first, int words, char *out) {
+    int n = 0;
+    for (int w = first; w < first + words; w++) {
+        out[n++] = (char)(id[w] >> 8);
+        out[n++] = (char)(id[w] & 0xFF);
+    }
+    while (n > 0 && out[n - 1] == ' ') n--;
+    out[n] = '\0';
+}
+
+/* capability words; the transfer settings are filled in by ata_configure */
+static void ata_parse_identify(BYTE pdrv, const uint16_t *id) {
+    ata_info_t *info = &ata_info[pdrv];
+    memset(info, 0, sizeof(*info));
+
+    ata_identify_string(id, 27, 20, info->model);
+    ata_identify_string(id, 10, 10, info->serial);
+    ata_identify_string(id, 23, 4, info->firmware);
+
+    /* word 47 low byte: largest READ/WRITE MULTIPLE block.
+       word 59 bit 8: low byte holds the block size currently set */
+    info->multi_max = (BYTE)(id[47] & 0xFF);
+    if (id[59] & 0x0100) info->multi = (BYTE)(id[59] & 0xFF);
+
+    /* word 53 bit 1: words 64..70 valid; bit 2: word 88 valid */
+    info->pio_mode = 2;
+    if (id[53] & 0x0002) {
+        if (id[64] & 0x0002)      info->pio_mode = 4;
+        else if (id[64] & 0x0001) info->pio_mode = 3;
+    }
+    info->mdma_modes = (BYTE)(id[63] & 0x07);
+    if (id[53] & 0x0004) info->udma_modes = (BYTE)(id[88] & 0x7F);
+
+    /* a mode the BIOS already selected shows up in the high bytes */
+    int udma_sel = (id[53] & 0x0004) ? (id[88] >> 8) & 0x7F : 0;
+    int mdma_sel = (id[63] >> 8) & 0x07;
+    if (udma_sel)      info->xfer_mode = ATA_XFER_UDMA | (BYTE)(31 - __builtin_clz(udma_sel));
+    else if (mdma_sel) info->xfer_mode = ATA_XFER_MDMA | (BYTE)(31 - __builtin_clz(mdma_sel));
+
+    /* word 82 bit 5: write cache supported; word 85 bit 5: enabled */
+    info->wcache_supported = (id[82] & 0x0020) ? 1 : 0;
+    info->wcache_enabled   = (id[85] & 0x0020) ? 1 : 0;
+}
+
+static void ata_probe_absent(ata_probe_t *p) {
+    drive_present[p->pdrv] = 0;
+    total_sectors[p->pdrv] = 0;
+    p->state = ATA_PROBE_DONE;
+}
 
+/* read the IDENTIFY block that is ready on the data port and record the drive */
+static void ata_probe_finish(ata_probe_t *p, uint16_t io_base) {
+    BYTE pdrv = p->pdrv;
+
+    /* read IDENTIFY data */
+    uint16_t identify_buf[256];
+    ata_read_data(io_base, identify_buf);
+
+    /* extract total 28-bit sectors from words 60 and 61 */
+    uint32_t low  = identify_buf[60];
+    uint32_t high = identify_buf[61];
+    total_sectors[pdrv] = (high << 16) | low;
+
+    /* word 83 bit 10: 48-bit feature set; words 100..103 hold the 48-bit size */
+    ata_lba48[pdrv] = (identify_buf[83] & 0x0400) ? 1 : 0;
+    if (ata_lba48[pdrv]) {
+        uint64_t lba48_sectors = (uint64_t)identify_buf[100]
+                               | ((uint64_t)identify_buf[101] << 16)
+                               | ((uint64_t)identify_buf[102] << 32)
+                               | ((uint64_t)identify_buf[103] << 48);
+        if (lba48_sectors > total_sectors[pdrv]) {
+            total_sectors[pdrv] = lba48_sectors;
+        }
+    }
+
+    /* word 49 bit 8: DMA supported */
+    ata_dma_capable[pdrv] = (identify_buf[49] & 0x0100) ? 1 : 0;
+
+    ata_parse_identify(pdrv, identify_buf);
+
+    /* mark drive present */
+    drive_present[pdrv] = 1;
+    p->state = ATA_PROBE_DONE;
+    DBG_PRINTF("pdrv %d: present, total sectors = %lu\n", pdrv, total_sectors[pdrv]);
+}
+
+/* select the position. a channel with nothing attached floats high and
+   reads 0xFF, so it is given up on without any waiting */
+static void ata_probe_begin(ata_probe_t *p, BYTE pdrv) {
     uint16_t io_base, ctrl_base;
     uint8_t drive_sel;
     pdrv_to_ata(pdrv, &io_base, &ctrl_base, &drive_sel);
 
-    DBG_PRINTF("phys init pdrv %d (I/O=0x%X, CTRL=0x%X, SEL=0x%X)\n", pdrv, io_base, ctrl_base, drive_sel);
+    p->pdrv  = pdrv;
+    p->state = ATA_PROBE_SPINUP;
+    p->since = get_time_ms();
 
-    /* reset Device Control register: de-assert SRST, enable IRQs */
+    if (ata_read_alt_status(ctrl_base) == 0xFF) {
+        DBG_PRINTF("pdrv %d: floating bus, channel empty\n", pdrv);
+        ata_probe_absent(p);
+        return;
+    }
+
+    /* Device Control: SRST de-asserted, IRQs enabled */
     outb(ctrl_base, 0x00);
-    delay_ms(50);  /* let control port settle */
 
     /* select drive (master/slave) with LBA bit set */
     outb(io_base + 6, drive_sel);
-    delay_ms(1000);  /* give real hardware time to spin up (1s) */
+    ata_delay_400ns(ctrl_base);
+}
+
+/* advance one position's probe without blocking */
+static void ata_probe_step(ata_probe_t *p) {
+    uint16_t io_base, ctrl_base;
+    uint8_t drive_sel;
+    pdrv_to_ata(p->pdrv, &io_base, &ctrl_base, &drive_sel);
 
-    /* clear LBA registers */
-    outb(io_base + 2, 0x00);
-    outb(io_base + 3, 0x00);
-    outb(io_base + 4, 0x00);
-    outb(io_base + 5, 0x00);
+    uint8_t status = ata_read_alt_status(ctrl_base);
+    uint32_t waited = get_time_ms() - p->since;
 
-    /* send IDENTIFY */
-    ata_send_command(io_base, ATA_CMD_IDENTIFY);
+    if (p->state == ATA_PROBE_SPINUP) {
+        if (status == 0xFF) {
+            ata_probe_absent(p);
+            return;
+        }
+        if (status & ATA_STATUS_BUSY) {
+            /* a drive still spinning up; give it until the deadline */
+            if (waited >= ATA_SPINUP_TIMEOUT_MS) {
+                DBG_PRINTF("pdrv %d: still busy after spin-up deadline\n", p->pdrv);
+                ata_probe_absent(p);
+            }
+            return;
+        }
+
+        /* clear LBA registers */
+        outb(io_base + 2, 0x00);
+        outb(io_base + 3, 0x00);
+        outb(io_base + 4, 0x00);
+        outb(io_base + 5, 0x00);
+
+        /* send IDENTIFY */
+        ata_send_command(io_base, ATA_CMD_IDENTIFY);
+        ata_delay_400ns(ctrl_base);
+
+        p->state = ATA_PROBE_IDENTIFY;
+        p->since = get_time_ms();
+        return;
+    }
 
-    /* wait for BSY clear using alternate status port */
-    uint8_t status = wait_for_bsy_clear(ctrl_base);
-    if (status == 0xFF) {
-        /* timed out or no drive */
-        drive_present[pdrv] = 0;
-        total_sectors[pdrv] = 0;
-        DBG_PRINTF("pdrv %d: no response or timeout\n", pdrv);
-        return STA_NOINIT;
+    /* ATA_PROBE_IDENTIFY */
+    if (status == 0x00 || status == 0xFF) {
+        /* nothing drives the status register: no device at this position */
+        ata_probe_absent(p);
+        return;
     }
+    if (!(status & ATA_STATUS_BUSY)) {
+        if (status & ATA_STATUS_ERR) {
+            /* ATAPI devices abort IDENTIFY and leave their signature in
+               LBAMID/LBAHIGH (0x14/0xEB or 0x69/0x96); skip those and
+               anything else that refuses the command */
+            DBG_PRINTF("pdrv %d: IDENTIFY aborted (LBAMID=0x%X, LBAHIGH=0x%X)\n",
+                       p->pdrv, inb(io_base + 4), inb(io_base + 5));
+            ata_probe_absent(p);
+            return;
+        }
+        if (status & ATA_STATUS_DRQ) {
+            ata_read_status(io_base);  /* acknowledge the interrupt */
+            ata_probe_finish(p, io_base);
+            return;
+        }
+    }
+    if (waited >= ATA_IDENTIFY_TIMEOUT_MS) {
+        DBG_PRINTF("pdrv %d: no response or timeout\n", p->pdrv);
+        ata_probe_absent(p);
+    }
+}
 
-    /* check if ERROR */
+/*-----------------------------------------------------------------------*/
+/* Commands without a data phase (SET FEATURES, FLUSH CACHE, ...)        */
+/*-----------------------------------------------------------------------*/
+#define ATA_ABORTED (-2)
+
+/* returns 0, ATA_ABORTED if the drive refused the command, or -1 */
+static int ata_nodata_command(BYTE pdrv, uint8_t cmd, uint8_t feature, uint8_t count,
+                              uint32_t timeout_ms) {
+    uint16_t io_base, ctrl_base;
+    uint8_t drive_sel;
+    pdrv_to_ata(pdrv, &io_base, &ctrl_base, &drive_sel);
+
+    uint8_t channel = ATA_CHANNEL(pdrv);
+
+    outb(io_base + 6, drive_sel);
+    ata_delay_400ns(ctrl_base);
+    if (wait_for_bsy_clear(ctrl_base, ATA_TIMEOUT_MS) == 0xFF) {
+        return -1;
+    }
+
+    ata_irq_clear(channel);
+    disk_note_commands(1);
+    outb(io_base + 1, feature);
+    outb(io_base + 2, count);
+    ata_send_command(io_base, cmd);
+    ata_delay_400ns(ctrl_base);
+
+    int status = ata_wait_irq(channel, ctrl_base, timeout_ms);
+    if (status < 0 || (status & ATA_STATUS_DF)) {
+        DBG_PRINTF("pdrv %d: command 0x%X failed (status=0x%X)\n", pdrv, cmd, status);
+        return -1;
+    }
     if (status & ATA_STATUS_ERR) {
-        drive_present[pdrv] = 0;
-        total_sectors[pdrv] = 0;
-        DBG_PRINTF("pdrv %d: IDENTIFY reported error (status=0x%X)\n", pdrv, status);
-        return STA_NOINIT;
-    }
-
-    /* check for ATAPI signature: read LBA mid/high registers */
-    {
-        uint8_t lbamid  = inb(io_base + 4);
-        uint8_t lbahigh = inb(io_base + 5);
-        DBG_PRINTF("pdrv %d: LBAMID=0x%X, LBAHIGH=0x%X\n", pdrv, lbamid, lbahigh);
-        /* ATAPI devices set LBAMID=0x14, LBAHIGH=0xEB or 0x69/0x96 */
-        if ((lbamid == 0x14 && lbahigh == 0xEB) ||
-            (lbamid == 0x69 && lbahigh == 0x96)) {
-            /* atapi or packet device, skip it */
-            drive_present[pdrv] = 0;
-            total_sectors[pdrv] = 0;
-            DBG_PRINTF("pdrv %d: ATAPI detected or unsupported device\n", pdrv);
-            return STA_NOINIT;
+        return (inb(io_base + 1) & ATA_ERROR_ABRT) ? ATA_ABORTED : -1;
+    }
+    return 0;
+}
+
+/* turn on what IDENTIFY offered: block-mode PIO, the write cache, and a
+   DMA transfer mode if the BIOS didn't pick one */
+static void ata_configure(BYTE pdrv) {
+    ata_info_t *info = &ata_info[pdrv];
+
+    if (info->multi_max > 1 && info->multi != info->multi_max) {
+        if (ata_nodata_command(pdrv, ATA_CMD_SET_MULTIPLE, 0, info->multi_max, ATA_TIMEOUT_MS) == 0) {
+            info->multi = info->multi_max;
+        } else {
+            info->multi = 0;
         }
     }
 
-    /* wait for DRQ */
-    if (!(status & ATA_STATUS_DRQ)) {
-        /* sometimes need to poll again for DRQ */
-        if (wait_for_drq_set(io_base) < 0) {
-            drive_present[pdrv] = 0;
-            total_sectors[pdrv] = 0;
-            DBG_PRINTF("pdrv %d: DRQ never set\n", pdrv);
-            return STA_NOINIT;
+    /* CTRL_SYNC issues FLUSH CACHE, so cached writes still reach the media */
+    if (info->wcache_supported && !info->wcache_enabled) {
+        if (ata_nodata_command(pdrv, ATA_CMD_SET_FEATURES, ATA_FEAT_WCACHE_ON, 0, ATA_TIMEOUT_MS) == 0) {
+            info->wcache_enabled = 1;
         }
     }
 
-    /* read IDENTIFY data */
-    uint16_t identify_buf[256];
-    ata_read_data(io_base, identify_buf);
+    /* a mode the BIOS set up matches the controller timing it programmed;
+       keep it. otherwise ask for the fastest one; if the controller can't
+       keep up, DMA errors make ata_transfer fall back to PIO */
+    if (!info->xfer_mode && ata_dma_capable[pdrv] && ata_bm_base[ATA_CHANNEL(pdrv)]) {
+        uint8_t mode = 0;
+        if (info->udma_modes) {
+            mode = ATA_XFER_UDMA | (uint8_t)(31 - __builtin_clz(info->udma_modes));
+        } else if (info->mdma_modes) {
+            mode = ATA_XFER_MDMA | (uint8_t)(31 - __builtin_clz(info->mdma_modes));
+        }
+        if (mode && ata_nodata_command(pdrv, ATA_CMD_SET_FEATURES, ATA_FEAT_XFER_MODE, mode,
+                                       ATA_TIMEOUT_MS) == 0) {
+            info->xfer_mode = mode;
+        }
+    }
+}
 
-    /* extract total 28-bit sectors from words 60 and 61 */
-    uint32_t low  = identify_buf[60];
-    uint32_t high = identify_buf[61];
-    total_sectors[pdrv] = (high << 16) | low;
+/* sectors per PIO data block: 1 unless READ/WRITE MULTIPLE is set up */
+static UINT ata_pio_block(BYTE pdrv) {
+    return (ata_info[pdrv].multi > 1) ? ata_info[pdrv].multi : 1;
+}
 
-    /* mark drive present */
-    drive_present[pdrv] = 1;
-    DBG_PRINTF("pdrv %d: present, total sectors = %lu\n", pdrv, total_sectors[pdrv]);
-    return 0;  /* success */
+int ata_get_info(BYTE pdrv, ata_info_t *out) {
+    if (pdrv >= ATA_MAX_DRIVES || phys_type[pdrv] != DISK_TYPE_ATA || !drive_present[pdrv]) {
+        return -1;
+    }
+    *out = ata_info[pdrv];
+    out->lba48 = ata_lba48[pdrv];
+    out->dma = (BYTE)ata_dma_active(pdrv);
+    return 0;
 }
 
 /*-----------------------------------------------------------------------*/
-/* Physical drive status (0..3)                                         */
+/* ATA drive initialize (0..3) – returns STA_NOINIT or 0                */
 /*-----------------------------------------------------------------------*/
-static DSTATUS phys_disk_status(BYTE pdrv) {
-    if (pdrv >= MAX_DRIVES) return STA_NOINIT;
+static DSTATUS ata_disk_initialize(BYTE pdrv) {
+    if (pdrv >= ATA_MAX_DRIVES) return STA_NOINIT;
+
+    ata_probe_t probe;
+    ata_probe_begin(&probe, pdrv);
+    while (probe.state != ATA_PROBE_DONE) {
+        ata_probe_step(&probe);
+    }
     if (!drive_present[pdrv]) return STA_NOINIT;
-    return 0;  /* drive ready */
+
+    ata_configure(pdrv);
+    return 0;
+}
+
+/* pick the opcode for a transfer; LBA48 drives always get the EXT form.
+   PIO uses the MULTIPLE commands once SET MULTIPLE MODE took */
+static uint8_t ata_rw_command(BYTE pdrv, int dma, int write) {
+    int multi = !dma && ata_pio_block(pdrv) > 1;
+    if (ata_lba48[pdrv]) {
+        if (dma) return write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+        if (multi) return write ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE_EXT;
+        return write ? ATA_CMD_WRITE_EXT : ATA_CMD_READ_EXT;
+    }
+    if (dma) return write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA;
+    if (multi) return write ? ATA_CMD_WRITE_MULTIPLE : ATA_CMD_READ_MULTIPLE;
+    return write ? ATA_CMD_WRITE : ATA_CMD_READ;
 }
 
 /*-----------------------------------------------------------------------*/
-/* Physical Read Sector(s)                                                */
+/* Bus-master DMA (PIIX-style PCI IDE controller)                        */
 /*-----------------------------------------------------------------------*/
-static DRESULT phys_disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
-    if (pdrv >= MAX_DRIVES)      return RES_PARERR;
-    if (!drive_present[pdrv])    return RES_NOTRDY;
-    if (count == 0)              return RES_PARERR;
 
+/* locate the IDE controller and its bus-master register block (BAR4) */
+static void ata_dma_init(void) {
+    pci_device_t dev;
+
+    ata_bm_base[0] = ata_bm_base[1] = 0;
+    if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, 0, &dev)) return;
+    if (!(dev.prog_if & 0x80)) return;          /* controller can't bus-master */
+
+    uint32_t bar4 = pci_read_bar(&dev, 4);
+    if (bar4 == 0) return;
+
+    pci_enable(&dev, PCI_CMD_IO_SPACE | PCI_CMD_BUS_MASTER);
+
+    /* a channel in native PCI mode has moved off the legacy ports we drive */
+    if (!(dev.prog_if & 0x01)) ata_bm_base[0] = (uint16_t)bar4;
+    if (!(dev.prog_if & 0x04)) ata_bm_base[1] = (uint16_t)(bar4 + 8);
+
+    DBG_PRINTF("IDE bus master at 0x%X (prog_if 0x%X)\n", bar4, dev.prog_if);
+}
+
+int ata_dma_active(BYTE pdrv) {
+    if (pdrv >= ATA_MAX_DRIVES || !drive_present[pdrv]) return 0;
+    return ata_dma_enabled && ata_dma_capable[pdrv] && ata_bm_base[ATA_CHANNEL(pdrv)] != 0;
+}
+
+void ata_set_dma(int enabled) {
+    ata_dma_enabled = enabled ? 1 : 0;
+}
+
+/* describe buff as this channel's PRD table. no region may cross a 64 KiB
+   boundary. returns -1 if the buffer can't be used for DMA */
+static int ata_build_prdt(uint8_t channel, const BYTE *buff, uint32_t bytes) {
+    uint32_t addr = (uint32_t)buff;  /* no paging: virtual == physical */
+    int i = 0;
+
+    if (addr & 0x01) return -1;      /* regions must be word aligned */
+
+    while (bytes > 0) {
+        if (i == ATA_PRD_ENTRIES) return -1;
+
+        uint32_t room = 0x10000 - (addr & 0xFFFF);
+        uint32_t len  = (bytes < room) ? bytes : room;
+
+        ata_prdt[channel][i].addr  = addr;
+        ata_prdt[channel][i].bytes = (uint16_t)len;  /* 64 KiB is encoded as 0 */
+        ata_prdt[channel][i].flags = 0;
+
+        addr  += len;
+        bytes -= len;
+        i++;
+    }
+    ata_prdt[channel][i - 1].flags = ATA_PRD_EOT;
+    return 0;
+}
+
+/* one READ DMA / WRITE DMA (EXT) command of n sectors (see ata_max_sectors).
+   returns 0 on success, ATA_DMA_UNUSABLE if the buffer can't be described
+   (caller should use PIO), or -1 if the transfer itself failed */
+static int ata_dma_transfer(BYTE pdrv, BYTE *buff, LBA_t sector, UINT n, int write) {
     uint16_t io_base, ctrl_base;
     uint8_t drive_sel;
     pdrv_to_ata(pdrv, &io_base, &ctrl_base, &drive_sel);
 
-    for (UINT i = 0; i < count; i++) {
-        LBA_t current_sector = sector + i;
+    uint8_t channel = ATA_CHANNEL(pdrv);
+    uint16_t bm = ata_bm_base[channel];
+    uint8_t dir = write ? 0 : BM_CMD_READ;
 
-        /* de-assert SRST, enable IRQs before every operation */
-        outb(ctrl_base, 0x00);
-        delay_ms(10);
+    if (ata_build_prdt(channel, buff, n * 512) < 0) return ATA_DMA_UNUSABLE;
 
-        /* select drive + head bits (LBA high 4 bits) */
-        uint8_t head_byte = drive_sel | (uint8_t)((current_sector >> 24) & 0x0F);
-        outb(io_base + 6, head_byte);
-        delay_ms(500);  /* let the drive process head select */
+    /* PRD table and (for writes) the data must be in memory before the engine runs */
+    __asm__ volatile ("" ::: "memory");
 
-        /* send sector count = 1 */
-        outb(io_base + 2, 0x01);
+    outb(bm + BM_COMMAND, dir);  /* engine stopped, direction set */
+    outl(bm + BM_PRDT, (uint32_t)&ata_prdt[channel][0]);
+    outb(bm + BM_STATUS, inb(bm + BM_STATUS) | BM_STATUS_ERR | BM_STATUS_IRQ);
 
-        /* set LBA low/mid/high */
-        outb(io_base + 3, (uint8_t)(current_sector & 0xFF));          /* LBA bits 0..7 */
-        outb(io_base + 4, (uint8_t)((current_sector >> 8) & 0xFF));   /* LBA bits 8..15 */
-        outb(io_base + 5, (uint8_t)((current_sector >> 16) & 0xFF));  /* LBA bits 16..23 */
+    ata_irq_clear(channel);
+    if (ata_issue_rw(io_base, ctrl_base, drive_sel, sector, n,
+                     ata_rw_command(pdrv, 1, write), ata_lba48[pdrv]) < 0) {
+        return -1;
+    }
+    outb(bm + BM_COMMAND, dir | BM_CMD_START);
 
-        /* send READ command */
-        ata_send_command(io_base, ATA_CMD_READ);
+    /* one interrupt for the whole command */
+    int status = ata_wait_irq(channel, ctrl_base, ATA_TIMEOUT_MS);
 
-        /* wait for BSY clear */
-        uint8_t status2 = wait_for_bsy_clear(ctrl_base);
-        if (status2 == 0xFF) {
-            DBG_PRINTF("pdrv %d: read sector %lu timed out on BSY\n", pdrv, current_sector);
-            return RES_ERROR;
-        }
+    uint8_t bm_status = inb(bm + BM_STATUS);
+    outb(bm + BM_COMMAND, dir);
+    outb(bm + BM_STATUS, bm_status | BM_STATUS_ERR | BM_STATUS_IRQ);
 
-        /* wait for DRQ */
-        if (wait_for_drq_set(io_base) < 0) {
-            DBG_PRINTF("pdrv %d: read sector %lu DRQ error\n", pdrv, current_sector);
-            return RES_ERROR;
-        }
+    /* the engine wrote behind the compiler's back */
+    __asm__ volatile ("" ::: "memory");
 
-        /* read one sector (512 bytes) */
-        ata_read_data(io_base, (uint16_t *)(buff + (i * 512)));
+    if (status < 0 || (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) || (bm_status & BM_STATUS_ERR)) {
+        DBG_PRINTF("pdrv %d: DMA failed (status=0x%X, bm=0x%X)\n", pdrv, status, bm_status);
+        return -1;
     }
-
-    return RES_OK;
+    return 0;
 }
 
-#if FF_FS_READONLY == 0
 /*-----------------------------------------------------------------------*/
-/* Physical Write Sector(s)                                               */
+/* PIO data transfers, one command of n sectors (see ata_max_sectors)    */
 /*-----------------------------------------------------------------------*/
-static DRESULT phys_disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
-    if (pdrv >= MAX_DRIVES)      return RES_PARERR;
-    if (!drive_present[pdrv])    return RES_NOTRDY;
-    if (count == 0)              return RES_PARERR;
-
+static int ata_pio_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT n) {
     uint16_t io_base, ctrl_base;
     uint8_t drive_sel;
     pdrv_to_ata(pdrv, &io_base, &ctrl_base, &drive_sel);
 
-    for (UINT i = 0; i < count; i++) {
-        LBA_t current_sector = sector + i;
+    uint8_t channel = ATA_CHANNEL(pdrv);
 
-        /* de-assert SRST, enable IRQs before every operation */
-        outb(ctrl_base, 0x00);
-        delay_ms(10);
+    ata_irq_clear(channel);
+    if (ata_issue_rw(io_base, ctrl_base, drive_sel, sector, n,
+                     ata_rw_command(pdrv, 0, 0), ata_lba48[pdrv]) < 0) {
+        DBG_PRINTF("pdrv %d: read sector %lu timed out on BSY\n", pdrv, sector);
+        return -1;
+    }
 
-        /* select drive + head bits (LBA high 4 bits) */
-        uint8_t head_byte = drive_sel | (uint8_t)((current_sector >> 24) & 0x0F);
-        outb(io_base + 6, head_byte);
-        delay_ms(500);  /* let the drive process head select */
+    /* the drive interrupts once per data block (a sector, or a READ
+       MULTIPLE block) with DRQ set; sleep until then */
+    UINT per_block = ata_pio_block(pdrv);
+    for (UINT i = 0; i < n; i += per_block) {
+        if (ata_wait_block(channel, ctrl_base, 1) < 0) {
+            DBG_PRINTF("pdrv %d: read sector %lu DRQ error\n", pdrv, sector + i);
+            return -1;
+        }
+        for (UINT s = i; s < n && s < i + per_block; s++) {
+            ata_read_data(io_base, (uint16_t *)buff);
+            buff += 512;
+        }
+    }
+    return 0;
+}
 
-        /* send sector count = 1 */
-        outb(io_base + 2, 0x01);
+static int ata_pio_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT n) {
+    uint16_t io_base, ctrl_base;
+    uint8_t drive_sel;
+    pdrv_to_ata(pdrv, &io_base, &ctrl_base, &drive_sel);
 
-        /* set LBA low/mid/high */
-        outb(io_base + 3, (uint8_t)(current_sector & 0xFF));
-        outb(io_base + 4, (uint8_t)((current_sector >> 8) & 0xFF));
-        outb(io_base + 5, (uint8_t)((current_sector >> 16) & 0xFF));
+    uint8_t channel = ATA_CHANNEL(pdrv);
 
-        /* send WRITE command */
-        ata_send_command(io_base, ATA_CMD_WRITE);
+    ata_irq_clear(channel);
+    if (ata_issue_rw(io_base, ctrl_base, drive_sel, sector, n,
+                     ata_rw_command(pdrv, 0, 1), ata_lba48[pdrv]) < 0) {
+        DBG_PRINTF("pdrv %d: write sector %lu timed out on BSY\n", pdrv, sector);
+        return -1;
+    }
 
-        /* wait for BSY clear */
-        uint8_t status2 = wait_for_bsy_clear(ctrl_base);
-        if (status2 == 0xFF) {
-            DBG_PRINTF("pdrv %d: write sector %lu timed out on BSY\n", pdrv, current_sector);
-            return RES_ERROR;
+    UINT per_block = ata_pio_block(pdrv);
+    for (UINT i = 0; i < n; i += per_block) {
+        /* no IRQ precedes the first block; every later one is announced */
+        int ok = (i == 0) ? ata_wait_data(io_base, ctrl_base)
+                          : ata_wait_block(channel, ctrl_base, 1);
+        if (ok < 0) {
+            DBG_PRINTF("pdrv %d: write sector %lu DRQ error\n", pdrv, sector + i);
+            return -1;
         }
+        ata_irq_clear(channel);
+        for (UINT s = i; s < n && s < i + per_block; s++) {
+            ata_write_data(io_base, (const uint16_t *)buff);
+            buff += 512;
+        }
+    }
 
-        /* wait for DRQ */
-        if (wait_for_drq_set(io_base) < 0) {
-            DBG_PRINTF("pdrv %d: write sector %lu DRQ error\n", pdrv, current_sector);
-            return RES_ERROR;
+    /* the final IRQ arrives once the last block has been committed */
+    if (ata_wait_block(channel, ctrl_base, 0) < 0) {
+        DBG_PRINTF("pdrv %d: write sector %lu failed\n", pdrv, sector);
+        return -1;
+    }
+    return 0;
+}
+
+/* the whole range must lie on the disk and, without LBA48, below 128 GiB */
+static int ata_lba_reachable(BYTE pdrv, LBA_t sector, UINT count) {
+    uint64_t end = (uint64_t)sector + count;
+    if (end > total_sectors[pdrv]) return 0;
+    if (!ata_lba48[pdrv] && end > ATA_LBA28_LIMIT) return 0;
+    return 1;
+}
+
+/* largest transfer a single command can carry on this drive */
+static UINT ata_max_sectors(BYTE pdrv) {
+    if (!ata_lba48[pdrv])     return ATA_MAX_SECTORS_PER_CMD;
+    if (ata_dma_active(pdrv)) return ATA_DMA_MAX_SECTORS;
+    return ATA_MAX_SECTORS_PER_EXT_CMD;
+}
+
+/* run one command's worth of sectors, preferring DMA. a failed DMA command
+   turns DMA off for that drive and is retried with PIO */
+static int ata_transfer(BYTE pdrv, BYTE *buff, LBA_t sector, UINT n, int write) {
+    disk_note_commands(1);
+    if (ata_dma_active(pdrv)) {
+        int r = ata_dma_transfer(pdrv, buff, sector, n, write);
+        if (r == 0) return 0;
+        if (r != ATA_DMA_UNUSABLE) {
+            DBG_PRINTF("pdrv %d: falling back to PIO\n", pdrv);
+            ata_dma_capable[pdrv] = 0;
+            disk_note_retry();
         }
+        disk_note_commands(1);
+    }
+    return write ? ata_pio_write(pdrv, buff, sector, n)
+                 : ata_pio_read(pdrv, buff, sector, n);
+}
 
-        /* write one sector (512 bytes) */
-        ata_write_data(io_base, (const uint16_t *)(buff + (i * 512)));
+/*-----------------------------------------------------------------------*/
+/* ATA Read Sector(s)                                                     */
+/*-----------------------------------------------------------------------*/
+static DRESULT ata_disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    if (pdrv >= ATA_MAX_DRIVES)  return RES_PARERR;
+    if (!drive_present[pdrv])    return RES_NOTRDY;
+    if (count == 0)              return RES_PARERR;
+    if (!ata_lba_reachable(pdrv, sector, count)) return RES_PARERR;
+
+    while (count > 0) {
+        UINT max = ata_max_sectors(pdrv);
+        UINT n = (count > max) ? max : count;
+
+        if (ata_transfer(pdrv, buff, sector, n, 0) < 0) return RES_ERROR;
+
+        buff   += n * 512;
+        sector += n;
+        count  -= n;
+    }
+
+    return RES_OK;
+}
+
+#if FF_FS_READONLY == 0
+/*-----------------------------------------------------------------------*/
+/* ATA Write Sector(s)                                                    */
+/*-----------------------------------------------------------------------*/
+static DRESULT ata_disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
+    if (pdrv >= ATA_MAX_DRIVES)  return RES_PARERR;
+    if (!drive_present[pdrv])    return RES_NOTRDY;
+    if (count == 0)              return RES_PARERR;
+    if (!ata_lba_reachable(pdrv, sector, count)) return RES_PARERR;
+
+    while (count > 0) {
+        UINT max = ata_max_sectors(pdrv);
+        UINT n = (count > max) ? max : count;
+
+        /* the DMA engine only reads from buff for writes */
+        if (ata_transfer(pdrv, (BYTE *)buff, sector, n, 1) < 0) return RES_ERROR;
+
+        buff   += n * 512;
+        sector += n;
+        count  -= n;
     }
 
     return RES_OK;
@@ -329,20 +913,34 @@ static DRESULT phys_disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT c
 #endif
 
 /*-----------------------------------------------------------------------*/
-/* Physical I/O control                                                  */
+/* FLUSH CACHE: commit the drive's own write cache to the media          */
 /*-----------------------------------------------------------------------*/
-static DRESULT phys_disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
-    if (pdrv >= MAX_DRIVES)      return RES_PARERR;
+static int ata_flush_cache(BYTE pdrv) {
+    int r = ata_nodata_command(pdrv, ata_lba48[pdrv] ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE,
+                               0, 0, ATA_FLUSH_TIMEOUT_MS);
+    /* old drives without a write cache abort the command; nothing to flush */
+    return (r == ATA_ABORTED) ? 0 : r;
+}
+
+/*-----------------------------------------------------------------------*/
+/* ATA I/O control                                                       */
+/*-----------------------------------------------------------------------*/
+static DRESULT ata_disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+    if (pdrv >= ATA_MAX_DRIVES)  return RES_PARERR;
     if (!drive_present[pdrv])    return RES_NOTRDY;
 
     DRESULT res = RES_OK;
     switch (cmd) {
         case CTRL_SYNC:
-            /* nothing to do for ATA */
+            if (ata_flush_cache(pdrv) < 0) res = RES_ERROR;
             break;
         case GET_SECTOR_COUNT:
-            /* return the sector count detected */
-            *(DWORD *)buff = total_sectors[pdrv];
+            /* return the sector count detected, clipped to what LBA_t can hold */
+            if (total_sectors[pdrv] > (LBA_t)-1) {
+                *(LBA_t *)buff = (LBA_t)-1;
+            } else {
+                *(LBA_t *)buff = (LBA_t)total_sectors[pdrv];
+            }
             break;
         case GET_SECTOR_SIZE:
             *(WORD *)buff = 512;
@@ -357,6 +955,207 @@ static DRESULT phys_disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
     return res;
 }
 
+/*-----------------------------------------------------------------------*/
+/* Physical drive table: dispatch to the driver behind each pdrv         */
+/*-----------------------------------------------------------------------*/
+
+BYTE disk_register(BYTE type, BYTE unit) {
+    BYTE free_slot = 0xFF;
+    for (BYTE pdrv = ATA_MAX_DRIVES; pdrv < MAX_PHYS_DRIVES; pdrv++) {
+        if (phys_type[pdrv] == type && phys_unit[pdrv] == unit) return pdrv;  /* already known */
+        if (phys_type[pdrv] == DISK_TYPE_NONE && free_slot == 0xFF) free_slot = pdrv;
+    }
+    if (free_slot != 0xFF) {
+        phys_type[free_slot] = type;
+        phys_unit[free_slot] = unit;
+        drive_present[free_slot] = 1;
+    }
+    return free_slot;
+}
+
+BYTE disk_type(BYTE pdrv) {
+    return (pdrv < MAX_PHYS_DRIVES) ? phys_type[pdrv] : DISK_TYPE_NONE;
+}
+
+void disk_describe(BYTE pdrv, char *out, int len) {
+    static const char *ata_names[ATA_MAX_DRIVES] = {
+        "primary master", "primary slave", "secondary master", "secondary slave"
+    };
+
+    switch (disk_type(pdrv)) {
+        case DISK_TYPE_ATA:
+            snprintf(out, len, "%s", ata_names[pdrv]);
+            break;
+        case DISK_TYPE_AHCI:
+            snprintf(out, len, "SATA port %d%s", ahci_unit_port(phys_unit[pdrv]),
+                     ahci_unit_ncq(phys_unit[pdrv]) ? ", NCQ" : "");
+            break;
+        case DISK_TYPE_VIRTIO:
+            snprintf(out, len, "virtio disk %d", phys_unit[pdrv]);
+            break;
+        case DISK_TYPE_RAM:
+            snprintf(out, len, "RAM disk %d, %u KB%s", phys_unit[pdrv],
+                     ramdisk_sectors(phys_unit[pdrv]) / 2,
+                     ramdisk_read_only(phys_unit[pdrv]) ? ", read-only" : "");
+            break;
+        default:
+            snprintf(out, len, "unknown?");
+            break;
+    }
+}
+
+static DSTATUS phys_disk_initialize(BYTE pdrv) {
+    switch (disk_type(pdrv)) {
+        case DISK_TYPE_ATA:    return ata_disk_initialize(phys_unit[pdrv]);
+        case DISK_TYPE_AHCI:   return ahci_disk_initialize(phys_unit[pdrv]);
+        case DISK_TYPE_VIRTIO: return virtio_blk_initialize(phys_unit[pdrv]);
+        case DISK_TYPE_RAM:    return ramdisk_initialize(phys_unit[pdrv]);
+        default:               return STA_NOINIT;
+    }
+}
+
+static DSTATUS phys_disk_status(BYTE pdrv) {
+    if (pdrv >= MAX_PHYS_DRIVES) return STA_NOINIT;
+    if (!drive_present[pdrv]) return STA_NOINIT;
+    /* only virtio and RAM disks report write protection; their "initialize" is a pure status check */
+    if (phys_type[pdrv] == DISK_TYPE_VIRTIO) return virtio_blk_initialize(phys_unit[pdrv]);
+    if (phys_type[pdrv] == DISK_TYPE_RAM) return ramdisk_initialize(phys_unit[pdrv]);
+    return 0;  /* drive ready */
+}
+
+static DRESULT phys_driver_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    switch (disk_type(pdrv)) {
+        case DISK_TYPE_ATA:    return ata_disk_read(phys_unit[pdrv], buff, sector, count);
+        case DISK_TYPE_AHCI:   return ahci_disk_read(phys_unit[pdrv], buff, sector, count);
+        case DISK_TYPE_VIRTIO: return virtio_blk_read(phys_unit[pdrv], buff, sector, count);
+        case DISK_TYPE_RAM:    return ramdisk_read(phys_unit[pdrv], buff, sector, count);
+        default:               return RES_PARERR;
+    }
+}
+
+#if FF_FS_READONLY == 0
+static DRESULT phys_driver_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
+    switch (disk_type(pdrv)) {
+        case DISK_TYPE_ATA:    return ata_disk_write(phys_unit[pdrv], buff, sector, count);
+        case DISK_TYPE_AHCI:   return ahci_disk_write(phys_unit[pdrv], buff, sector, count);
+        case DISK_TYPE_VIRTIO: return virtio_blk_write(phys_unit[pdrv], buff, sector, count);
+        case DISK_TYPE_RAM:    return ramdisk_write(phys_unit[pdrv], buff, sector, count);
+        default:               return RES_PARERR;
+    }
+}
+#endif
+
+static DRESULT phys_driver_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+    switch (disk_type(pdrv)) {
+        case DISK_TYPE_ATA:    return ata_disk_ioctl(phys_unit[pdrv], cmd, buff);
+        case DISK_TYPE_AHCI:   return ahci_disk_ioctl(phys_unit[pdrv], cmd, buff);
+        case DISK_TYPE_VIRTIO: return virtio_blk_ioctl(phys_unit[pdrv], cmd, buff);
+        case DISK_TYPE_RAM:    return ramdisk_ioctl(phys_unit[pdrv], cmd, buff);
+        default:               return RES_PARERR;
+    }
+}
+
+/*-----------------------------------------------------------------------*/
+/* Per-drive I/O accounting                                              */
+/*-----------------------------------------------------------------------*/
+
+static disk_stats_t phys_stats[MAX_PHYS_DRIVES];
+
+/* drive whose request is in the driver right now (0xFF: none), so the
+   drivers can report commands, timeouts and retries by unit number */
+static BYTE io_pdrv = 0xFF;
+
+void disk_note_commands(UINT n) {
+    if (io_pdrv != 0xFF) phys_stats[io_pdrv].cmds += n;
+}
+
+void disk_note_timeout(void) {
+    if (io_pdrv != 0xFF) phys_stats[io_pdrv].timeouts++;
+}
+
+void disk_note_retry(void) {
+    if (io_pdrv != 0xFF) phys_stats[io_pdrv].retries++;
+}
+
+/* log2 bucket of a latency: 0 for < 2 us, i for 2^i..2^(i+1)-1 us */
+static int disk_hist_bucket(uint32_t us) {
+    if (us < 2) return 0;
+    int b = 31 - __builtin_clz(us);
+    return (b >= DISK_HIST_BUCKETS) ? DISK_HIST_BUCKETS - 1 : b;
+}
+
+/* charge one finished request to pdrv. hist: read or write histogram, or NULL */
+static void disk_account(BYTE pdrv, uint32_t start_us, DRESULT res, DWORD *hist) {
+    disk_stats_t *st = &phys_stats[pdrv];
+    uint32_t us = get_time_us() - start_us;
+
+    st->busy_us += us % 1000;
+    st->busy_ms += us / 1000 + st->busy_us / 1000;
+    st->busy_us %= 1000;
+    if (hist) hist[disk_hist_bucket(us)]++;
+    if (res != RES_OK) st->errors++;
+}
+
+static DRESULT phys_disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    if (pdrv >= MAX_PHYS_DRIVES) return RES_PARERR;
+
+    BYTE prev = io_pdrv;
+    io_pdrv = pdrv;
+    uint32_t start = get_time_us();
+    DRESULT res = phys_driver_read(pdrv, buff, sector, count);
+    io_pdrv = prev;
+
+    phys_stats[pdrv].reads++;
+    if (res == RES_OK) phys_stats[pdrv].sectors_read += count;
+    disk_account(pdrv, start, res, phys_stats[pdrv].read_hist);
+    return res;
+}
+
+#if FF_FS_READONLY == 0
+static DRESULT phys_disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
+    if (pdrv >= MAX_PHYS_DRIVES) return RES_PARERR;
+
+    BYTE prev = io_pdrv;
+    io_pdrv = pdrv;
+    uint32_t start = get_time_us();
+    DRESULT res = phys_driver_write(pdrv, buff, sector, count);
+    io_pdrv = prev;
+
+    phys_stats[pdrv].writes++;
+    if (res == RES_OK) phys_stats[pdrv].sectors_written += count;
+    disk_account(pdrv, start, res, phys_stats[pdrv].write_hist);
+    return res;
+}
+#endif
+
+static DRESULT phys_disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+    if (pdrv >= MAX_PHYS_DRIVES) return RES_PARERR;
+    /* only a cache flush touches the media; the rest are table lookups */
+    if (cmd != CTRL_SYNC) return phys_driver_ioctl(pdrv, cmd, buff);
+
+    BYTE prev = io_pdrv;
+    io_pdrv = pdrv;
+    uint32_t start = get_time_us();
+    DRESULT res = phys_driver_ioctl(pdrv, cmd, buff);
+    io_pdrv = prev;
+
+    phys_stats[pdrv].flushes++;
+    disk_account(pdrv, start, res, NULL);
+    return res;
+}
+
+void disk_get_stats(BYTE pdrv, disk_stats_t *out) {
+    if (pdrv >= MAX_PHYS_DRIVES) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    *out = phys_stats[pdrv];
+}
+
+void disk_reset_stats(void) {
+    memset(phys_stats, 0, sizeof(phys_stats));
+}
+
 /*-----------------------------------------------------------------------*/
 /* Public FatFs API wrappers (logical → physical mapping)                */
 /*-----------------------------------------------------------------------*/
@@ -365,9 +1164,47 @@ static DRESULT phys_disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
 /* Probe all 4 possible ATA drives and initialize their presence status */
 /*-----------------------------------------------------------------------*/
 void probe_all_ata_drives(void) {
-    for (BYTE pdrv = 0; pdrv < MAX_DRIVES; pdrv++) {
-        /* call physical init to detect the drive */
-        phys_disk_initialize(pdrv);
+    ata_dma_init();
+
+    /* master and slave share a channel and must be taken in turn, but the
+       primary and secondary channels are independent: probe them together */
+    for (BYTE pos = 0; pos < 2; pos++) {
+        ata_probe_t probe[2];
+        ata_probe_begin(&probe[0], 0 + pos);
+        ata_probe_begin(&probe[1], 2 + pos);
+
+        while (probe[0].state != ATA_PROBE_DONE || probe[1].state != ATA_PROBE_DONE) {
+            if (probe[0].state != ATA_PROBE_DONE) ata_probe_step(&probe[0]);
+            if (probe[1].state != ATA_PROBE_DONE) ata_probe_step(&probe[1]);
+        }
+    }
+
+    for (BYTE pdrv = 0; pdrv < ATA_MAX_DRIVES; pdrv++) {
+        if (drive_present[pdrv]) ata_configure(pdrv);
+    }
+}
+
+/*-----------------------------------------------------------------------*/
+/* Probe every supported controller; drives land in the physical table   */
+/*-----------------------------------------------------------------------*/
+void probe_all_drives(void) {
+    probe_all_ata_drives();
+
+    int n = ahci_init();
+    for (int unit = 0; unit < n; unit++) {
+        disk_register(DISK_TYPE_AHCI, (BYTE)unit);
+    }
+
+    n = virtio_blk_init();
+    for (int unit = 0; unit < n; unit++) {
+        disk_register(DISK_TYPE_VIRTIO, (BYTE)unit);
+    }
+
+    /* FAT images GRUB loaded as modules; they come after the real disks */
+    ramdisk_attach_modules();
+    n = ramdisk_count();
+    for (int unit = 0; unit < n; unit++) {
+        disk_register(DISK_TYPE_RAM, (BYTE)unit);
     }
 }
 
@@ -390,6 +1227,11 @@ DSTATUS disk_initialize(BYTE logical_drv) {
 
     BYTE pdrv = logical_to_physical[logical_drv];
     if (pdrv == 0xFF) return STA_NOINIT;       /* unmapped logical */
+
+    /* the media may have changed; nothing cached for it can be trusted.
+       pending write-back data still belongs to the old media */
+    bcache_flush(logical_drv);
+    bcache_invalidate(logical_drv);
     return phys_disk_initialize(pdrv);
 }
 
@@ -402,6 +1244,22 @@ DRESULT disk_read(BYTE logical_drv, BYTE *buff, LBA_t sector, UINT count) {
     BYTE pdrv = logical_to_physical[logical_drv];
     if (pdrv == 0xFF || !drive_present[pdrv]) return RES_NOTRDY;
 
+    /* a RAM disk is as fast as the cache; copying through it only wastes space */
+    if (phys_type[pdrv] == DISK_TYPE_RAM) return phys_disk_read(pdrv, buff, sector, count);
+
+    /* through the block cache, which calls disk_read_direct on a miss */
+    return bcache_read(logical_drv, buff, sector, count);
+}
+
+/*-----------------------------------------------------------------------*/
+/* Read Sector(s) by logical drive, bypassing the block cache            */
+/*-----------------------------------------------------------------------*/
+DRESULT disk_read_direct(BYTE logical_drv, BYTE *buff, LBA_t sector, UINT count) {
+    if (logical_drv >= MAX_DRIVES) return RES_PARERR;
+
+    BYTE pdrv = logical_to_physical[logical_drv];
+    if (pdrv == 0xFF || !drive_present[pdrv]) return RES_NOTRDY;
+
     return phys_disk_read(pdrv, buff, sector, count);
 }
 
@@ -415,6 +1273,21 @@ DRESULT disk_write(BYTE logical_drv, const BYTE *buff, LBA_t sector, UINT count)
     BYTE pdrv = logical_to_physical[logical_drv];
     if (pdrv == 0xFF || !drive_present[pdrv]) return RES_NOTRDY;
 
+    if (phys_type[pdrv] == DISK_TYPE_RAM) return phys_disk_write(pdrv, buff, sector, count);
+
+    /* the cache writes through (or, in write-back mode, later) with disk_write_direct */
+    return bcache_write(logical_drv, buff, sector, count);
+}
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s) by logical drive, bypassing the block cache           */
+/*-----------------------------------------------------------------------*/
+DRESULT disk_write_direct(BYTE logical_drv, const BYTE *buff, LBA_t sector, UINT count) {
+    if (logical_drv >= MAX_DRIVES)      return RES_PARERR;
+
+    BYTE pdrv = logical_to_physical[logical_drv];
+    if (pdrv == 0xFF || !drive_present[pdrv]) return RES_NOTRDY;
+
     return phys_disk_write(pdrv, buff, sector, count);
 }
 #endif
@@ -428,6 +1301,9 @@ DRESULT disk_ioctl(BYTE logical_drv, BYTE cmd, void *buff) {
     BYTE pdrv = logical_to_physical[logical_drv];
     if (pdrv == 0xFF || !drive_present[pdrv]) return RES_NOTRDY;
 
+    /* write back this drive's dirty blocks before the drive flushes its own cache */
+    if (cmd == CTRL_SYNC && bcache_flush(logical_drv) != RES_OK) return RES_ERROR;
+
     return phys_disk_ioctl(pdrv, cmd, buff);
 }
 
@@ -33,13 +33,76 @@ DRESULT disk_write (BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 
 
+/* Uncached access (diskio.c); disk_read/disk_write go through bcache.c */
+DRESULT disk_read_direct (BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);
+DRESULT disk_write_direct (BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
+
+/* Physical drive table (diskio.c) */
+void probe_all_drives (void);					/* detect drives on every supported controller */
+BYTE disk_register (BYTE type, BYTE unit);		/* add a driver's unit; returns its pdrv or 0xFF */
+BYTE disk_type (BYTE pdrv);						/* DISK_TYPE_* of a physical drive */
+void disk_describe (BYTE pdrv, char* out, int len);	/* e.g. "primary master", "SATA port 1", "virtio disk 0" */
+
+/* Per physical drive I/O statistics (diskio.c), counted where requests
+   enter the driver, i.e. below the block cache */
+#define DISK_HIST_BUCKETS 24	/* latency buckets: 0: < 2 us, i: 2^i .. 2^(i+1)-1 us */
+
+typedef struct {
+	DWORD reads, writes, flushes;			/* requests handed to the driver */
+	DWORD cmds;								/* device commands they took */
+	DWORD sectors_read, sectors_written;
+	DWORD errors, timeouts, retries;
+	DWORD busy_ms, busy_us;					/* time spent in the driver (busy_us < 1000) */
+	DWORD read_hist[DISK_HIST_BUCKETS];		/* request latency, log2 microseconds */
+	DWORD write_hist[DISK_HIST_BUCKETS];
+} disk_stats_t;
+
+void disk_get_stats (BYTE pdrv, disk_stats_t* out);
+void disk_reset_stats (void);
+
+/* Drivers report into the request currently being accounted */
+void disk_note_commands (UINT n);		/* n device commands issued */
+void disk_note_timeout (void);			/* the device did not answer in time */
+void disk_note_retry (void);			/* a command is repeated in a fallback mode */
+
+/* ATA driver controls (diskio.c) */
+int  ata_dma_active (BYTE pdrv);	/* 1 if transfers to physical drive pdrv use bus-master DMA */
+void ata_set_dma (int enabled);		/* allow (1) or forbid (0) DMA; PIO is used otherwise */
+
+/* What an ATA drive reported in IDENTIFY and what was negotiated with it */
+typedef struct {
+	char model[41];
+	char serial[21];
+	char firmware[9];
+	BYTE lba48;
+	BYTE dma;						/* transfers use bus-master DMA */
+	BYTE multi_max;					/* largest READ/WRITE MULTIPLE block, 0: none */
+	BYTE multi;						/* block size in use, 0 or 1: one sector per interrupt */
+	BYTE pio_mode;					/* fastest PIO mode supported */
+	BYTE mdma_modes, udma_modes;	/* supported modes, bit n: mode n */
+	BYTE xfer_mode;					/* DMA mode in effect: 0x20|n MDMA n, 0x40|n UDMA n, 0: none */
+	BYTE wcache_supported, wcache_enabled;
+} ata_info_t;
+
+int  ata_get_info (BYTE pdrv, ata_info_t* out);	/* 0, or -1 if pdrv is no ATA drive */
+
+
 /* Disk Status Bits (DSTATUS) */
 
 #define STA_NOINIT		0x01	/* Drive not initialized */
 #define STA_NODISK		0x02	/* No medium in the drive */
 #define STA_PROTECT		0x04	/* Write protected */
 
-#define MAX_DRIVES       4   /* 2 channels × 2 drives each */
+#define MAX_DRIVES       4   /* logical drives (FatFs volumes) */
+#define ATA_MAX_DRIVES   4   /* 2 channels × 2 drives each: physical drives 0..3 */
+#define MAX_PHYS_DRIVES  16  /* ATA positions, then drives of other controllers */
+
+/* Physical drive types (disk_type) */
+#define DISK_TYPE_NONE   0
+#define DISK_TYPE_ATA    1
+#define DISK_TYPE_AHCI   2
+#define DISK_TYPE_VIRTIO 3
+#define DISK_TYPE_RAM    4
 
 /* Command code for disk_ioctrl fucntion */
 
@@ -9,11 +9,16 @@
 #include "disks.h"    // <-- include our own header first
 #include "ff.h"
 #include "diskio.h"
+#include "bcache.h"
 #include "stdlib.h"
 #include "string.h"
 #include "console.h"
 #include "screen.h"
 #include "keyboard.h"
+#include "time.h"
+#include "ramdisk.h"
+#include "memory.h"
+#include "walk.h"
 #include <stdint.h>
 
 // Global file system objects (one per logical drive)
@@ -25,14 +30,10 @@ char cwd[MAX_LOGICAL_DRIVES][MAX_PATH_LEN];
 // Track the active drive when user omits drive letter (default to 0)
 int current_drive = 0;
 
-// Number of lines per page for directory listing
-#define LINES_PER_PAGE 25
-
 // Indicates whether at least one drive was mounted
 static int mounted_any = 0;
 
 // Forward‐declare the low‐level probe function (must be implemented elsewhere)
-extern void probe_all_ata_drives(void);
 
 // Prototypes for internal helpers
 static void init_cwd(void);
@@ -172,14 +173,220 @@ const char* get_current_directory(void) {
     }
 }
 
+//------------------------------------------------------------
+// Paging for long output
+//------------------------------------------------------------
+#define VIEW_PAGE     (NUM_ROWS - 1)   // text lines per screen; the last one holds --More--
+
+// --More-- prompt on the current (empty) line. Returns the number of lines
+// to show next: a page for most keys, one for Enter, 0 for q/Esc.
+static size_t more_prompt(uint32_t percent) {
+    printf("--More-- (%u%%)  Space: page  Enter: line  q: quit", percent);
+    update_cursor();
+
+    int key = getch();
+
+    col = 0;
+    for (int i = 0; i < NUM_COLS - 1; i++) printc(' ');
+    col = 0;
+
+    if (key == 'q' || key == 'Q' || key == 27) return 0;
+    if (key == '\n') return 1;
+    return VIEW_PAGE;
+}
+
+// Show a block of text a screenful at a time (one header line is
+// assumed to be on the screen already)
+static void page_text(const char *text, size_t len) {
+    size_t lines = VIEW_PAGE - 1;
+    size_t pos = 0;
+    while (pos < len) {
+        pos += console_write(text + pos, len - pos, &lines);
+        if (lines == 0 && pos < len) {
+            lines = more_prompt((uint32_t)(pos / 16 * 100 / (len / 16 + 1)));
+            if (lines == 0) break;
+        }
+    }
+    if (col != 0) newline();
+    update_cursor();
+}
+
+//------------------------------------------------------------
+// Directory snapshots: a directory is read once into a sorted array
+// and kept until something in the volume's directories changes
+// (FatFs bumps fs->dir_mod on every directory entry update)
+//------------------------------------------------------------
+#define DIR_SNAP_SLOTS     4
+#define DIR_SNAP_MAX_ITEMS 4096
+#define DIR_COL_WIDTH      16      // 8.3 name + '/' + padding; 5 columns
+
+typedef struct {
+    char name[13];
+    BYTE attr;
+    DWORD size;
+    WORD date;
+    WORD time;
+} dir_item_t;
+
+typedef struct {
+    int valid;
+    int truncated;         // more than DIR_SNAP_MAX_ITEMS entries (or out of memory)
+    FATFS *fs;
+    WORD fs_id;            // mount ID, so a remount or format drops the snapshot
+    DWORD dir_mod;         // fs->dir_mod when it was read
+    DWORD sclust;          // directory start cluster (0: root)
+    UINT count;
+    dir_item_t *items;
+    uint32_t used;         // LRU stamp
+} dir_snapshot_t;
+
+static dir_snapshot_t dir_snaps[DIR_SNAP_SLOTS];
+static uint32_t dir_snap_clock;
+
+// directories first, then by name
+static int dir_item_cmp(const void *a, const void *b) {
+    const dir_item_t *x = a;
+    const dir_item_t *y = b;
+    int xd = (x->attr & AM_DIR) != 0;
+    int yd = (y->attr & AM_DIR) != 0;
+    if (xd != yd) return yd - xd;
+    return strcmp(x->name, y->name);
+}
+
+static dir_snapshot_t *dir_snapshot(const char *full_path, FRESULT *res_out) {
+    DIR dir;
+    FRESULT res = f_opendir(&dir, full_path);
+    if (res != FR_OK) {
+        *res_out = res;
+        return NULL;
+    }
+
+    FATFS *fs = dir.obj.fs;
+    dir_snapshot_t *snap = NULL;
+    dir_snapshot_t *victim = &dir_snaps[0];
+    for (int i = 0; i < DIR_SNAP_SLOTS; i++) {
+        dir_snapshot_t *s = &dir_snaps[i];
+        if (s->valid && s->fs == fs && s->fs_id == fs->id && s->sclust == dir.obj.sclust) {
+            snap = s;
+            break;
+        }
+        if (victim->valid && (!s->valid || s->used < victim->used)) victim = s;
+    }
+
+    if (snap && snap->dir_mod == fs->dir_mod) {
+        f_closedir(&dir);
+        snap->used = ++dir_snap_clock;
+        *res_out = FR_OK;
+        return snap;
+    }
+
+    if (!snap) snap = victim;
+    free(snap->items);
+    memset(snap, 0, sizeof(*snap));
+
+    UINT cap = 0;
+    FILINFO fno;
+    while ((res = f_readdir(&dir, &fno)) == FR_OK && fno.fname[0] != 0) {
+        if (snap->count == cap) {
+            UINT grow = cap ? cap * 2 : 32;
+            if (grow > DIR_SNAP_MAX_ITEMS) grow = DIR_SNAP_MAX_ITEMS;
+            dir_item_t *bigger = (grow > cap) ? realloc(snap->items, grow * sizeof(dir_item_t)) : NULL;
+            if (!bigger) {
+                snap->truncated = 1;
+                break;
+            }
+            snap->items = bigger;
+            cap = grow;
+        }
+        dir_item_t *it = &snap->items[snap->count++];
+        strncpy(it->name, fno.fname, sizeof(it->name) - 1);
+        it->name[sizeof(it->name) - 1] = '\0';
+        it->attr = fno.fattrib;
+        it->size = fno.fsize;
+        it->date = fno.fdate;
+        it->time = fno.ftime;
+    }
+    f_closedir(&dir);
+
+    if (res != FR_OK) {
+        free(snap->items);
+        memset(snap, 0, sizeof(*snap));
+        *res_out = res;
+        return NULL;
+    }
+
+    qsort(snap->items, snap->count, sizeof(dir_item_t), dir_item_cmp);
+    snap->fs = fs;
+    snap->fs_id = fs->id;
+    snap->dir_mod = fs->dir_mod;
+    snap->sclust = dir.obj.sclust;
+    snap->used = ++dir_snap_clock;
+    snap->valid = 1;
+    *res_out = FR_OK;
+    return snap;
+}
+
+// Lay the snapshot out as text: names in columns (sorted down each
+// column), or one line per entry with size and time stamp
+static size_t dir_format(const dir_snapshot_t *snap, int long_format, char *out, size_t cap) {
+    size_t pos = 0;
+    uint32_t files = 0, dirs = 0, bytes = 0;
+
+    for (UINT i = 0; i < snap->count; i++) {
+        const dir_item_t *it = &snap->items[i];
+        if (it->attr & AM_DIR) {
+            if (strcmp(it->name, ".") && strcmp(it->name, "..")) dirs++;
+        } else {
+            files++;
+            bytes += it->size;
+        }
+    }
+
+    if (long_format) {
+        for (UINT i = 0; i < snap->count && pos < cap; i++) {
+            const dir_item_t *it = &snap->items[i];
+            char size[12];
+            if (it->attr & AM_DIR) snprintf(size, sizeof(size), "<DIR>");
+            else snprintf(size, sizeof(size), "%u", it->size);
+            pos += snprintf(out + pos, cap - pos, "%-12s %10s  %04u-%02u-%02u %02u:%02u\n",
+                            it->name, size,
+                            1980 + (it->date >> 9), (it->date >> 5) & 15, it->date & 31,
+                            it->time >> 11, (it->time >> 5) & 63);
+        }
+    } else {
+        UINT columns = NUM_COLS / DIR_COL_WIDTH;
+        UINT rows = (snap->count + columns - 1) / columns;
+        for (UINT r = 0; r < rows && pos < cap; r++) {
+            size_t line = pos;
+            for (UINT c = 0; c < columns && pos < cap; c++) {
+                UINT i = c * rows + r;
+                if (i >= snap->count) break;
+                const dir_item_t *it = &snap->items[i];
+                pos += snprintf(out + pos, cap - pos, "%s%s", it->name, (it->attr & AM_DIR) ? "/" : "");
+                while (pos - line < (c + 1) * DIR_COL_WIDTH && pos < cap) out[pos++] = ' ';
+            }
+            while (pos > line && out[pos - 1] == ' ') pos--;   // no wrap at column 80
+            if (pos < cap) out[pos++] = '\n';
+        }
+    }
+
+    if (pos < cap) {
+        pos += snprintf(out + pos, cap - pos, "%u file(s), %u bytes; %u dir(s)%s\n",
+                        files, bytes, dirs, snap->truncated ? " (listing truncated)" : "");
+    }
+    return (pos < cap) ? pos : cap - 1;
+}
+
 //------------------------------------------------------------
 // List files in a directory with paging. Resolves relative or absolute.
 // 'path' examples:
 //   NULL or ""   => list cwd[current_drive]
 //   "SUBDIR"     => list cwd[current_drive]/SUBDIR
 //   "1:/DIR"     => list 1:/DIR
+// Entries come sorted from a cached snapshot, in columns or (long_format)
+// one per line with size and date, and go to the screen in one batch.
 //------------------------------------------------------------
-void list_directory_with_paging(const char *path) {
+void list_directory_with_paging(const char *path, int long_format) {
     char full_path[MAX_PATH_LEN];
 
     if (!path || path[0] == '\0') {
@@ -189,41 +396,26 @@ void list_directory_with_paging(const char *path) {
         get_full_path(path, full_path);
     }
 
-    DIR dir;
-    FILINFO fno;
-    FRESULT res = f_opendir(&dir, full_path);
-    if (res != FR_OK) {
+    FRESULT res;
+    dir_snapshot_t *snap = dir_snapshot(full_path, &res);
+    if (!snap) {
         print("Failed to open directory: ");
         println(full_path);
         return;
     }
 
-    uint32_t line_count = 0;
-    print("Listing directory: ");
-    println(full_path);
-
-    while (1) {
-        res = f_readdir(&dir, &fno);
-        if (res != FR_OK || fno.fname[0] == 0) break;
-
-        if (fno.fattrib & AM_DIR) {
-            print("[DIR]   ");
-        } else {
-            print("        ");
-        }
-        println(fno.fname);
-        curs_row++;
-        line_count++;
-
-        if (line_count >= LINES_PER_PAGE) {
-            getch();  // Wait for user input to continue
-            print("Press any key to continue...");
-            line_count = 0;
-            clear_screen();
-        }
+    size_t cap = (size_t)snap->count * (long_format ? 48 : 20) + 128;
+    char *text = malloc(cap);
+    if (!text) {
+        println("Out of memory.");
+        return;
     }
+    size_t len = dir_format(snap, long_format, text, cap);
 
-    f_closedir(&dir);
+    print("Listing directory: ");
+    println(full_path);
+    page_text(text, len);
+    free(text);
 }
 
 //------------------------------------------------------------
@@ -236,7 +428,7 @@ void list_all_root_directories(void) {
         snprintf(drv_root, sizeof(drv_root), "%d:/", i);
         print("----\nListing ");
         println(drv_root);
-        list_directory_with_paging(drv_root);
+        list_directory_with_paging(drv_root, 0);
     }
 }
 
@@ -244,13 +436,15 @@ void list_all_root_directories(void) {
 // Legacy: just list the cwd of the default drive
 //------------------------------------------------------------
 void list_root_directory(void) {
-    list_directory_with_paging(NULL);
+    list_directory_with_paging(NULL, 0);
 }
 
 //------------------------------------------------------------
 // Print the contents of a file, resolving drive letters or relative paths
 //------------------------------------------------------------
-void print_file(const char *filename) {
+#define VIEW_MAX_BUF  (32 * 1024)
+
+void print_file(const char *filename, DWORD offset) {
     char full_path[MAX_PATH_LEN];
     get_full_path(filename, full_path);
 
@@ -262,20 +456,56 @@ void print_file(const char *filename) {
         return;
     }
 
-    print("Reading file: ");
-    println(full_path);
+    if (offset > f_size(&fil)) offset = f_size(&fil);
+    if (offset > 0 && f_lseek(&fil, offset) != FR_OK) {
+        println("Seek failed.");
+        f_close(&fil);
+        return;
+    }
 
-    char buffer[128];
-    unsigned int bytes_read;
-    while (1) {
-        res = f_read(&fil, buffer, sizeof(buffer) - 1, &bytes_read);
-        if (res != FR_OK || bytes_read == 0) break;
-        buffer[bytes_read] = '\0';
-        println(buffer);
+    // one cluster per f_read: FatFs moves it straight into our buffer
+    // in a single disk request instead of through its sector window
+    UINT buf_size = fil.obj.fs->csize * 512;
+    if (buf_size > VIEW_MAX_BUF) buf_size = VIEW_MAX_BUF;
+    char small[512];
+    char *buffer = malloc(buf_size);
+    if (!buffer) {
+        buffer = small;
+        buf_size = sizeof(small);
+    }
+
+    if (offset > 0) printf("Reading file: %s from byte %u\n", full_path, offset);
+    else printf("Reading file: %s\n", full_path);
+
+    size_t lines = VIEW_PAGE - 1;
+    UINT br;
+    int quit = 0;
+    while (!quit) {
+        res = f_read(&fil, buffer, buf_size, &br);
+        if (res != FR_OK || br == 0) break;
+
+        UINT pos = 0;
+        while (pos < br) {
+            pos += console_write(buffer + pos, br - pos, &lines);
+            if (lines == 0) {
+                // nothing more to show is not worth a prompt
+                if (pos == br && f_tell(&fil) >= f_size(&fil)) break;
+                DWORD shown = f_tell(&fil) - (br - pos);
+                lines = more_prompt((shown / 1024) * 100 / (f_size(&fil) / 1024 + 1));
+                if (lines == 0) {
+                    quit = 1;
+                    break;
+                }
+            }
+        }
     }
 
+    if (res != FR_OK) println("Read error.");
+    if (col != 0) newline();
+    update_cursor();
+
+    if (buffer != small) free(buffer);
     f_close(&fil);
-    curs_row++;
 }
 
 //------------------------------------------------------------
@@ -358,7 +588,12 @@ void check_disk_usage(void) {
     DWORD fre_clust, total_clust;
     FATFS *fs_ptr;
     char drv_root[3] = { '0' + current_drive, ':', '\0' };
-    f_getfree(drv_root, &fre_clust, &fs_ptr);
+    // the first call after mount builds the volume's free cluster bitmap;
+    // after that FatFs keeps the count and this returns without disk I/O
+    if (f_getfree(drv_root, &fre_clust, &fs_ptr) != FR_OK) {
+        printf("Drive %d: cannot read the FAT\n", current_drive);
+        return;
+    }
 
     total_clust = fs_ptr->n_fatent - 2;
     DWORD total_size = total_clust * fs_ptr->csize * 512;
@@ -369,17 +604,10 @@ void check_disk_usage(void) {
 }
 
 //------------------------------------------------------------
-// Format a disk (format a specific drive, e.g. "1:")
+// Make a fresh FAT volume on a mapped logical drive ("1:") and
+// mount it in that drive's slot
 //------------------------------------------------------------
-void format_disk(const char *drive_spec) {
-    char drv_root[3] = { '0' + current_drive, ':', '\0' };
-    if (drive_spec
-        && drive_spec[0] >= '0'
-        && drive_spec[0] <= '0' + (MAX_LOGICAL_DRIVES - 1)
-        && drive_spec[1] == ':') {
-        drv_root[0] = drive_spec[0];
-    }
-
+static FRESULT mkfs_and_mount(const char *drv_root) {
     MKFS_PARM opt = {
         .fmt = FM_FAT | FM_FAT32,
         .n_fat = 1,
@@ -390,12 +618,29 @@ void format_disk(const char *drive_spec) {
 
     BYTE workbuf[FF_MAX_SS];
 
-    println("formatting disk... (please be patient; this may take a while)");
     FRESULT res = f_mkfs(drv_root, &opt, workbuf, sizeof(workbuf));
+    if (res != FR_OK) return res;
+
+    f_mount(NULL, drv_root, 1);  // unmount just to be safe
+    return f_mount(&fs_array[drv_root[0] - '0'], drv_root, 1);  // remount
+}
+
+//------------------------------------------------------------
+// Format a disk (format a specific drive, e.g. "1:")
+//------------------------------------------------------------
+void format_disk(const char *drive_spec) {
+    char drv_root[3] = { '0' + current_drive, ':', '\0' };
+    if (drive_spec
+        && drive_spec[0] >= '0'
+        && drive_spec[0] <= '0' + (MAX_LOGICAL_DRIVES - 1)
+        && drive_spec[1] == ':') {
+        drv_root[0] = drive_spec[0];
+    }
+
+    println("formatting disk... (please be patient; this may take a while)");
+    FRESULT res = mkfs_and_mount(drv_root);
     if (res == FR_OK) {
         println("disk formatted successfully.");
-        f_mount(NULL, drv_root, 1);  // unmount just to be safe
-        f_mount(&fs_array[current_drive], drv_root, 1);  // remount
     } else {
         print("disk format failed. error code: ");
         printf("%d\n", res);
@@ -403,18 +648,59 @@ void format_disk(const char *drive_spec) {
 }
 
 
+//------------------------------------------------------------
+// Create a RAM disk, format it and mount it on the first free
+// logical drive
+//------------------------------------------------------------
+void create_ramdisk(UINT kb) {
+    int drv = 0;
+    while (drv < MAX_LOGICAL_DRIVES && logical_to_physical[drv] != 0xFF) drv++;
+    if (drv == MAX_LOGICAL_DRIVES) {
+        println("No free drive letter for a RAM disk.");
+        return;
+    }
+
+    int unit = ramdisk_create(kb * 2);
+    if (unit < 0) {
+        printf("Cannot create a %u KB RAM disk (%u KB free).\n", kb, (UINT)(high_available() / 1024));
+        return;
+    }
+    BYTE pdrv = disk_register(DISK_TYPE_RAM, (BYTE)unit);
+    if (pdrv == 0xFF) {
+        println("Physical drive table is full.");
+        return;
+    }
+
+    char drv_root[3] = { (char)('0' + drv), ':', '\0' };
+    logical_to_physical[drv] = pdrv;
+    snprintf(cwd[drv], MAX_PATH_LEN, "%s/", drv_root);
+
+    FRESULT res = mkfs_and_mount(drv_root);
+    if (res != FR_OK) {
+        printf("RAM disk format failed. error code: %d\n", res);
+        logical_to_physical[drv] = 0xFF;
+        return;
+    }
+    mounted_any = 1;
+    printf("RAM disk of %u KB mounted as %s\n", kb, drv_root);
+}
+
 //------------------------------------------------------------
 // Mount all filesystems (detect drives, mount each in order).
 // The first HDD found becomes logical "0:", next is "1:", etc.
 // If none found, prints a message and waits for a key.
 //------------------------------------------------------------
 void mount_all_filesystems(void) {
+    uint32_t start_ms = get_time_ms();
+
     init_cwd();  // reset working dirs
-    probe_all_ata_drives();  // detect drives
+    bcache_init();  // block cache, sized from free memory
+    probe_all_drives();  // detect drives (IDE, then AHCI)
+    uint32_t probe_ms = get_time_ms() - start_ms;
     mounted_any = 0;
     int logical_index = 0;
 
-    for (int pdrv = 0; pdrv < MAX_DRIVES; pdrv++) {
+    for (int pdrv = 0; pdrv < MAX_PHYS_DRIVES && logical_index < MAX_LOGICAL_DRIVES; pdrv++) {
         if (!drive_present[pdrv]) continue;
 
         // build logical name like "0:"
@@ -426,13 +712,9 @@ void mount_all_filesystems(void) {
             print("Mounted logical drive ");
             print(path);
             print(" from physical drive ");
-            switch (pdrv) {
-                case 0: println("(primary master)"); break;
-                case 1: println("(primary slave)"); break;
-                case 2: println("(secondary master)"); break;
-                case 3: println("(secondary slave)"); break;
-                default: println("(unknown?)"); break;
-            }
+            char name[32];
+            disk_describe((BYTE)pdrv, name, sizeof(name));
+            printf("(%s)\n", name);
 
             if (!mounted_any) {
                 current_drive = logical_index;
@@ -442,11 +724,13 @@ void mount_all_filesystems(void) {
             mounted_any = 1;
             logical_index++;
         } else {
-            print("Failed to mount physical drive ");
-            putchar('0' + pdrv);
-            println("");
+            printf("Failed to mount physical drive %d\n", pdrv);
+            logical_to_physical[logical_index] = 0xFF;
         }
     }
+
+    printf("Drive setup took %d ms (probing %d ms)\n",
+           (int)(get_time_ms() - start_ms), (int)probe_ms);
 }
 
 //------------------------------------------------------------
@@ -512,6 +796,42 @@ FRESULT file_open(const char *path, FIL *fil, BYTE mode) {
     return f_open(fil, full_path, mode);
 }
 
+//------------------------------------------------------------
+// Fast seek: map the file's cluster chain once, so that f_lseek
+// finds any offset without reading the FAT. The table has two
+// entries per fragment and grows to whatever the file needs.
+// While it is attached the file can't grow; writes must stay
+// inside f_size() until file_fastseek_release.
+//------------------------------------------------------------
+#define FASTSEEK_FIRST_ITEMS 32   // 15 fragments; most files have fewer
+
+FRESULT file_fastseek(FIL *fil) {
+    DWORD items = FASTSEEK_FIRST_ITEMS;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        DWORD *tbl = malloc(items * sizeof(DWORD));
+        if (!tbl) return FR_NOT_ENOUGH_CORE;
+
+        tbl[0] = items;
+        fil->cltbl = tbl;
+        FRESULT res = f_lseek(fil, CREATE_LINKMAP);
+        if (res == FR_OK) return FR_OK;
+
+        // too small: FatFs left the size it needs in tbl[0]
+        items = tbl[0];
+        fil->cltbl = NULL;
+        free(tbl);
+        if (res != FR_NOT_ENOUGH_CORE) return res;
+    }
+    return FR_NOT_ENOUGH_CORE;
+}
+
+void file_fastseek_release(FIL *fil) {
+    if (fil->cltbl) {
+        free(fil->cltbl);
+        fil->cltbl = NULL;
+    }
+}
+
 //------------------------------------------------------------
 // Read up to bufsize bytes from `path` into `buffer`. 
 // *read will be set to the actual bytes read.
@@ -550,44 +870,46 @@ FRESULT make_directory(const char *path) {
     return f_mkdir(full);
 }
 
-FRESULT list_directory_recursive(const char *path) {
+typedef struct {
+    uint32_t files;
+    uint32_t dirs;
+    uint32_t bytes;
+} lsr_totals_t;
+
+static int lsr_visit(const walk_entry_t *e, void *ctx) {
+    lsr_totals_t *t = ctx;
+    if (e->fno->fattrib & AM_DIR) {
+        print("[DIR] ");
+        t->dirs++;
+    } else {
+        print("      ");
+        t->files++;
+        t->bytes += e->fno->fsize;
+    }
+    println(e->path);
+    return WALK_CONTINUE;
+}
+
+FRESULT list_directory_recursive(const char *path, const char *pattern) {
     char full_path[MAX_PATH_LEN];
     get_full_path(path, full_path);
 
-    DIR dir;
-    FILINFO fno;
-    FRESULT res = f_opendir(&dir, full_path);
-    if (res != FR_OK) {
-        print("Failed to open directory: ");
-        println(full_path);
-        return res;
-    }
-
     print("Recursive listing of ");
     println(full_path);
 
-    while (1) {
-        res = f_readdir(&dir, &fno);
-        if (res != FR_OK || fno.fname[0] == 0) break;
-
-        char entry_path[MAX_PATH_LEN];
-        snprintf(entry_path, MAX_PATH_LEN, "%s/%s", full_path, fno.fname);
-
-        if (fno.fattrib & AM_DIR) {
-            print("[DIR] ");
-            println(entry_path);
-            // recursive call
-            if (strcmp(fno.fname, ".") && strcmp(fno.fname, "..")) {
-                list_directory_recursive(entry_path);
-            }
-        } else {
-            print("      ");
-            println(entry_path);
-        }
+    walk_filter_t filter = { 0 };
+    filter.name_glob = pattern;
+    lsr_totals_t totals = { 0 };
+    FRESULT res = walk_tree(full_path, pattern ? &filter : NULL, 0, lsr_visit, &totals);
+    if (res == FR_NO_PATH || res == FR_NO_FILE || res == FR_INVALID_NAME) {
+        print("Failed to open directory: ");
+        println(full_path);
+        return res;
     }
 
-    f_closedir(&dir);
-    return FR_OK;
+    printf("%u files, %u directories, %u bytes\n", totals.files, totals.dirs, totals.bytes);
+    if (res != FR_OK) println("Some directories could not be read.");
+    return res;
 }
 
 DWORD get_file_size(const char *path) {
@@ -603,34 +925,97 @@ DWORD get_file_size(const char *path) {
     return size;
 }
 
+#define COPY_BUF_KB       128    // one f_read/f_write per 128 KB
+#define COPY_MIN_BUF_KB   8      // what we settle for when the heap is tight
+#define COPY_PROGRESS_MIN (1024u * 1024u)
+#define COPY_PROGRESS_MS  250
+
+// KB/s without 64-bit division; fine up to ~4 TB
+static uint32_t copy_kbps(uint32_t kb, uint32_t ms) {
+    if (ms == 0) ms = 1;
+    return (kb < 4000000) ? kb * 1000 / ms : kb / ms * 1000;
+}
+
+static void copy_progress(uint32_t done, uint32_t total, uint32_t ms) {
+    uint32_t total_kb = total / 1024 ? total / 1024 : 1;
+    uint32_t mb10 = copy_kbps(done / 1024, ms) * 10 / 1024;
+    col = 0;
+    printf("%u / %u KB  %u%%  %u.%u MB/s   ", done / 1024, total / 1024,
+           done / 1024 * 100 / total_kb, mb10 / 10, mb10 % 10);
+}
+
 FRESULT copy_file(const char *src, const char *dst) {
     char full_src[MAX_PATH_LEN];
     char full_dst[MAX_PATH_LEN];
     get_full_path(src, full_src);
     get_full_path(dst, full_dst);
 
+    // a big buffer lets FatFs move whole runs of clusters per disk request;
+    // sector alignment keeps the drivers off their bounce buffers
+    UINT buf_size = COPY_BUF_KB * 1024;
+    void *raw = 0;
+    while (!(raw = malloc(buf_size + 511)) && buf_size > COPY_MIN_BUF_KB * 1024) buf_size /= 2;
+    if (!raw) return FR_NOT_ENOUGH_CORE;
+    BYTE *buffer = (BYTE *)(((uintptr_t)raw + 511) & ~(uintptr_t)511);
+
     FIL fsrc, fdst;
     FRESULT res = f_open(&fsrc, full_src, FA_READ);
-    if (res != FR_OK) return res;
+    if (res != FR_OK) {
+        free(raw);
+        return res;
+    }
 
     res = f_open(&fdst, full_dst, FA_WRITE | FA_CREATE_ALWAYS);
     if (res != FR_OK) {
         f_close(&fsrc);
+        free(raw);
         return res;
     }
 
-    BYTE buffer[512];
+    // reserve one contiguous run for the whole file up front; if the
+    // volume has none that big, the chain just grows as we write
+    uint32_t total = (uint32_t)f_size(&fsrc);
+    if (total > 0 && f_expand(&fdst, total, 1) == FR_OK) {
+        f_lseek(&fdst, 0);
+    }
+
+    int show = (total >= COPY_PROGRESS_MIN);
+    uint32_t done = 0;
+    uint32_t t0 = get_time_ms();
+    uint32_t last = t0;
     UINT br, bw;
     while (1) {
-        res = f_read(&fsrc, buffer, sizeof(buffer), &br);
+        res = f_read(&fsrc, buffer, buf_size, &br);
         if (res != FR_OK || br == 0) break;
 
         res = f_write(&fdst, buffer, br, &bw);
-        if (res != FR_OK || bw < br) break;
+        if (res != FR_OK) break;
+        if (bw < br) {
+            res = FR_DENIED;   // volume full
+            break;
+        }
+        done += br;
+
+        if (show && get_time_ms() - last >= COPY_PROGRESS_MS) {
+            last = get_time_ms();
+            copy_progress(done, total, last - t0);
+        }
     }
 
+    // the preallocation may be longer than what we managed to write
+    if (res == FR_OK) res = f_truncate(&fdst);
+    else f_truncate(&fdst);
+
     f_close(&fsrc);
-    f_close(&fdst);
+    FRESULT cres = f_close(&fdst);
+    if (res == FR_OK) res = cres;
+    free(raw);
+
+    if (show) {
+        copy_progress(done, total, get_time_ms() - t0);
+        println("");
+    }
+    if (res != FR_OK) f_unlink(full_dst);
     return res;
 }
 
@@ -695,3 +1080,356 @@ void normalize_path(char *path) {
     strncpy(path, temp, MAX_PATH_LEN - 1);
     path[MAX_PATH_LEN - 1] = '\0';
 }
+
+//------------------------------------------------------------
+// Time a raw sequential read of `sectors` sectors from the start of a
+// logical drive. returns KB/s, or -1 on a read error
+//------------------------------------------------------------
+static int time_raw_read(BYTE drv, BYTE *buf, UINT chunk, UINT sectors) {
+    uint32_t start = get_time_ms();
+    for (UINT done = 0; done < sectors; done += chunk) {
+        UINT n = (sectors - done < chunk) ? sectors - done : chunk;
+        if (disk_read_direct(drv, buf, done, n) != RES_OK) return -1;
+    }
+    uint32_t ms = get_time_ms() - start;
+    if (ms == 0) ms = 1;
+    return (int)(((uint32_t)sectors / 2 * 1000) / ms);
+}
+
+//------------------------------------------------------------
+// Compare PIO and bus-master DMA throughput on the same drive and
+// the same sectors. the drive is only read, never written
+//------------------------------------------------------------
+void ata_benchmark(const char *drive_spec, UINT sectors) {
+    int drv = current_drive;
+    if (drive_spec
+        && drive_spec[0] >= '0'
+        && drive_spec[0] <= '0' + (MAX_LOGICAL_DRIVES - 1)
+        && drive_spec[1] == ':') {
+        drv = drive_spec[0] - '0';
+    }
+
+    BYTE pdrv = logical_to_physical[drv];
+    if (pdrv == 0xFF || !drive_present[pdrv]) {
+        println("Drive not present.");
+        return;
+    }
+
+    const UINT chunk = 128;  // sectors per disk_read (64 KB)
+    BYTE *buf = malloc(chunk * 512);
+    if (!buf) {
+        println("Out of memory.");
+        return;
+    }
+
+    printf("Reading %d KB from drive %d: in %d KB requests\n", (int)(sectors / 2), drv, (int)(chunk / 2));
+
+    ata_set_dma(0);
+    int pio = time_raw_read((BYTE)drv, buf, chunk, sectors);
+    ata_set_dma(1);
+
+    if (pio < 0) {
+        println("PIO: read error");
+    } else {
+        printf("PIO: %d KB/s\n", pio);
+    }
+
+    if (!ata_dma_active(pdrv)) {
+        println("DMA: not available on this drive/controller");
+    } else {
+        int dma = time_raw_read((BYTE)drv, buf, chunk, sectors);
+        if (dma < 0) {
+            println("DMA: read error");
+        } else {
+            printf("DMA: %d KB/s\n", dma);
+        }
+    }
+
+    free(buf);
+}
+
+//------------------------------------------------------------
+// Print block cache size and hit/miss counters
+//------------------------------------------------------------
+void print_cache_stats(void) {
+    bcache_stats_t st;
+    bcache_get_stats(&st);
+
+    if (st.blocks == 0) {
+        println("Block cache disabled (not enough memory).");
+        return;
+    }
+
+    uint32_t total = st.hits + st.misses;
+    uint32_t pct = 0;
+    if (total) {
+        // keep hits * 100 inside 32 bits
+        pct = (total < 0x1000000) ? st.hits * 100 / total : st.hits / (total / 100);
+    }
+
+    printf("Block cache: %d KB (%d sectors), %d in use\n",
+           (int)(st.blocks / 2), (int)st.blocks, (int)st.used);
+    printf("Hits: %d  Misses: %d  Hit rate: %d%%\n", (int)st.hits, (int)st.misses, (int)pct);
+    printf("Mode: %s  Dirty: %d\n", bcache_writeback_enabled() ? "write-back" : "write-through",
+           (int)st.dirty);
+    printf("Sector writes: %d requested, %d written in %d commands\n",
+           (int)(st.absorbed + st.written), (int)st.written, (int)st.write_cmds);
+    printf("Read-ahead: %d sectors prefetched, %d used, %d wasted\n",
+           (int)st.ra_fetched, (int)st.ra_hits, (int)st.ra_wasted);
+}
+
+//------------------------------------------------------------
+// Write back cached data and flush every drive's write cache
+//------------------------------------------------------------
+int sync_all_drives(void) {
+    int ok = 1;
+    for (BYTE drv = 0; drv < MAX_LOGICAL_DRIVES; drv++) {
+        if (logical_to_physical[drv] == 0xFF) continue;
+        if (disk_ioctl(drv, CTRL_SYNC, 0) != RES_OK) ok = 0;
+    }
+    return ok;
+}
+
+//------------------------------------------------------------
+// Per-drive I/O statistics (iostat)
+//------------------------------------------------------------
+
+// physical drives worth reporting: present and handled by some driver
+static int iostat_drive_shown(BYTE pdrv) {
+    return disk_type(pdrv) != DISK_TYPE_NONE && drive_present[pdrv];
+}
+
+// "0:".."3:" for a mapped physical drive, "--" otherwise
+static const char* iostat_logical_name(BYTE pdrv) {
+    static char name[3];
+    for (int drv = 0; drv < MAX_LOGICAL_DRIVES; drv++) {
+        if (logical_to_physical[drv] == pdrv) {
+            name[0] = (char)('0' + drv);
+            name[1] = ':';
+            name[2] = '\0';
+            return name;
+        }
+    }
+    return "--";
+}
+
+// average of busy time over ops, in microseconds
+static uint32_t iostat_avg_us(DWORD busy_ms, DWORD busy_us, DWORD ops) {
+    if (ops == 0) return 0;
+    if (busy_ms < 4000000) return (busy_ms * 1000 + busy_us) / ops;
+    return busy_ms / ops * 1000;
+}
+
+// sectors * 1000 / 2 / ms without leaving 32 bits
+static uint32_t iostat_kb_per_s(DWORD sectors, uint32_t ms) {
+    if (ms == 0) return 0;
+    if (sectors < 8000000) return sectors * 500 / ms;
+    return sectors / ms * 500;
+}
+
+void print_iostat(void) {
+    int shown = 0;
+    for (BYTE pdrv = 0; pdrv < MAX_PHYS_DRIVES; pdrv++) {
+        if (!iostat_drive_shown(pdrv)) continue;
+
+        disk_stats_t st;
+        char name[32];
+        disk_get_stats(pdrv, &st);
+        disk_describe(pdrv, name, sizeof(name));
+
+        printf("pdrv %d (%s) as %s\n", pdrv, name, iostat_logical_name(pdrv));
+        printf("  Reads: %u (%u KB)  Writes: %u (%u KB)  Flushes: %u  Commands: %u\n",
+               st.reads, st.sectors_read / 2, st.writes, st.sectors_written / 2,
+               st.flushes, st.cmds);
+        printf("  Errors: %u  Timeouts: %u  Retries: %u  Busy: %u ms  Avg latency: %u us\n",
+               st.errors, st.timeouts, st.retries, st.busy_ms,
+               iostat_avg_us(st.busy_ms, st.busy_us, st.reads + st.writes + st.flushes));
+        shown++;
+    }
+    if (!shown) {
+        println("No drives.");
+        return;
+    }
+
+    bcache_stats_t cs;
+    bcache_get_stats(&cs);
+    printf("Block cache: %u hits, %u misses, %u sectors read ahead\n",
+           cs.hits, cs.misses, cs.ra_fetched);
+}
+
+// "<2 us", "16 us", "2 ms", "1 s": lower bound of a histogram bucket
+static void iostat_bucket_label(int b, char *out, int len) {
+    if (b == 0) {
+        snprintf(out, len, "<2 us");
+        return;
+    }
+    uint32_t lo = 1u << b;
+    if (lo < 1000)         snprintf(out, len, "%u us", lo);
+    else if (lo < 1000000) snprintf(out, len, "%u ms", lo / 1000);
+    else                   snprintf(out, len, "%u s", lo / 1000000);
+}
+
+// latency below which pct percent of the requests finished (bucket upper bound, us)
+static uint32_t iostat_percentile(const DWORD *hist, DWORD total, uint32_t pct) {
+    uint32_t want = (total < 40000000) ? (total * pct + 99) / 100 : total / 100 * pct;
+    DWORD seen = 0;
+    for (int b = 0; b < DISK_HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen >= want) return (2u << b) - 1;
+    }
+    return (2u << (DISK_HIST_BUCKETS - 1)) - 1;
+}
+
+static void iostat_print_hist(const char *what, const DWORD *hist) {
+    DWORD total = 0, peak = 0;
+    int first = -1, last = -1;
+    for (int b = 0; b < DISK_HIST_BUCKETS; b++) {
+        total += hist[b];
+        if (hist[b] > peak) peak = hist[b];
+        if (hist[b]) {
+            if (first < 0) first = b;
+            last = b;
+        }
+    }
+    if (!total) {
+        printf("  %s: none\n", what);
+        return;
+    }
+
+    printf("  %s: %u requests, p50 < %u us, p90 < %u us, p99 < %u us\n", what, total,
+           iostat_percentile(hist, total, 50), iostat_percentile(hist, total, 90),
+           iostat_percentile(hist, total, 99));
+
+    for (int b = first; b <= last; b++) {
+        char label[12];
+        char bar[41];
+        int width = (int)((hist[b] * 40 + peak - 1) / peak);
+        if (peak > 100000000) width = (int)(hist[b] / (peak / 40 + 1));
+        for (int i = 0; i < width; i++) bar[i] = '#';
+        bar[width] = '\0';
+
+        iostat_bucket_label(b, label, sizeof(label));
+        printf("  %8s %8u %s\n", label, hist[b], bar);
+    }
+}
+
+void print_iostat_histogram(int pdrv) {
+    int shown = 0;
+    for (BYTE p = 0; p < MAX_PHYS_DRIVES; p++) {
+        if (pdrv >= 0 && p != pdrv) continue;
+        if (!iostat_drive_shown(p)) continue;
+
+        disk_stats_t st;
+        char name[32];
+        disk_get_stats(p, &st);
+        disk_describe(p, name, sizeof(name));
+
+        printf("pdrv %d (%s) latency:\n", p, name);
+        iostat_print_hist("Reads", st.read_hist);
+        iostat_print_hist("Writes", st.write_hist);
+        shown++;
+    }
+    if (!shown) println("No such drive.");
+}
+
+// highest set bit of a mode mask, -1 for none
+static int highest_mode(BYTE modes) {
+    return modes ? 31 - __builtin_clz(modes) : -1;
+}
+
+void print_disk_info(void) {
+    int shown = 0;
+    for (BYTE pdrv = 0; pdrv < MAX_PHYS_DRIVES; pdrv++) {
+        if (!iostat_drive_shown(pdrv)) continue;
+        shown++;
+
+        char name[32];
+        disk_describe(pdrv, name, sizeof(name));
+        printf("pdrv %d (%s) as %s\n", pdrv, name, iostat_logical_name(pdrv));
+
+        ata_info_t info;
+        if (ata_get_info(pdrv, &info) < 0) continue;  // IDENTIFY details are ATA only
+
+        printf("  Model: %s  Serial: %s  Firmware: %s\n", info.model, info.serial, info.firmware);
+        printf("  Addressing: %s  Write cache: %s\n", info.lba48 ? "LBA48" : "LBA28",
+               !info.wcache_supported ? "not supported" : info.wcache_enabled ? "on" : "off");
+
+        if (info.multi > 1) {
+            printf("  PIO: mode %d, %d sectors per interrupt (READ/WRITE MULTIPLE)\n",
+                   info.pio_mode, info.multi);
+        } else {
+            printf("  PIO: mode %d, 1 sector per interrupt\n", info.pio_mode);
+        }
+
+        printf("  DMA supported: UDMA %d, MDMA %d (-1 = none)\n",
+               highest_mode(info.udma_modes), highest_mode(info.mdma_modes));
+        if (!info.dma) {
+            println("  Transfers: PIO");
+        } else if (info.xfer_mode & 0x40) {
+            printf("  Transfers: DMA, UDMA mode %d\n", info.xfer_mode & 0x07);
+        } else if (info.xfer_mode & 0x20) {
+            printf("  Transfers: DMA, MDMA mode %d\n", info.xfer_mode & 0x07);
+        } else {
+            println("  Transfers: DMA, mode left to the drive");
+        }
+    }
+    if (!shown) println("No drives.");
+}
+
+// print per-interval rates every interval_ms until a key is pressed
+void iostat_watch(uint32_t interval_ms) {
+    // with their histograms these are ~4 KB: too much for the 8 KB kernel stack
+    static disk_stats_t prev[MAX_PHYS_DRIVES];
+    bcache_stats_t cprev;
+    for (BYTE p = 0; p < MAX_PHYS_DRIVES; p++) disk_get_stats(p, &prev[p]);
+    bcache_get_stats(&cprev);
+
+    println("Press any key to stop.");
+    println("pdrv    r/s    w/s   rKB/s   wKB/s  avg us  util");
+
+    uint32_t last = get_time_ms();
+    for (;;) {
+        // sleep in 1 ms timer ticks, letting the cache do its idle work
+        while (get_time_ms() - last < interval_ms) {
+            if (getch_nb() != -1) return;
+            bcache_idle();
+            asm volatile ("hlt");
+        }
+        uint32_t now = get_time_ms();
+        uint32_t ms = now - last;
+        last = now;
+
+        for (BYTE p = 0; p < MAX_PHYS_DRIVES; p++) {
+            if (!iostat_drive_shown(p)) continue;
+
+            disk_stats_t st;
+            disk_get_stats(p, &st);
+            DWORD reads  = st.reads - prev[p].reads;
+            DWORD writes = st.writes - prev[p].writes;
+            DWORD ops    = reads + writes + (st.flushes - prev[p].flushes);
+
+            // busy time of this interval, carried in ms + us like the counters
+            int32_t dus = (int32_t)st.busy_us - (int32_t)prev[p].busy_us;
+            DWORD dms = st.busy_ms - prev[p].busy_ms;
+            if (dus < 0) {
+                dus += 1000;
+                dms--;
+            }
+            uint32_t util = dms * 100 / ms;
+            if (util > 100) util = 100;
+
+            printf("%4d %6u %6u %7u %7u %7u %4u%%\n", p,
+                   reads * 1000 / ms, writes * 1000 / ms,
+                   iostat_kb_per_s(st.sectors_read - prev[p].sectors_read, ms),
+                   iostat_kb_per_s(st.sectors_written - prev[p].sectors_written, ms),
+                   iostat_avg_us(dms, (DWORD)dus, ops), util);
+            prev[p] = st;
+        }
+
+        bcache_stats_t cs;
+        bcache_get_stats(&cs);
+        printf("cache  %u hits/s, %u misses/s\n", (cs.hits - cprev.hits) * 1000 / ms,
+               (cs.misses - cprev.misses) * 1000 / ms);
+        cprev = cs;
+    }
+}
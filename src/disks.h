@@ -27,8 +27,9 @@ extern size_t input_col_offset; // this must be global for keyboard.c to use
 // Prints a message if no HDD is found.
 void mount_all_filesystems(void);
 
-// List files in a directory with paging (resolves relative or absolute paths)
-void list_directory_with_paging(const char *path);
+// List files in a directory with paging (resolves relative or absolute paths),
+// sorted, in columns or one per line with size and date (long_format)
+void list_directory_with_paging(const char *path, int long_format);
 
 // List root directories of all mounted drives
 void list_all_root_directories(void);
@@ -36,8 +37,9 @@ void list_all_root_directories(void);
 // (Legacy) List the current root directory of the default drive
 void list_root_directory(void);
 
-// Print the contents of a file (drive letter + path or relative path)
-void print_file(const char *filename);
+// Print the contents of a file (drive letter + path or relative path),
+// starting at byte offset, a screenful at a time with a --More-- prompt
+void print_file(const char *filename, DWORD offset);
 
 // Create or overwrite a file with given data
 void create_and_write_file(const char *filename, const char *data);
@@ -54,6 +56,10 @@ void rename_file(const char *old_name, const char *new_name);
 // Format a drive (e.g. "0:", "2:") — WARNING: wipes all data
 void format_disk(const char *drive_spec);
 
+// Create a RAM disk of kb KB and mount it, freshly formatted, as the
+// next free logical drive. The memory stays reserved until reboot.
+void create_ramdisk(UINT kb);
+
 // Check disk usage for current_drive
 void check_disk_usage(void);
 
@@ -71,7 +77,8 @@ const char* get_current_directory(void);
 
 int directory_exists(const char *path);
 FRESULT make_directory(const char *path);
-FRESULT list_directory_recursive(const char *path);
+// List everything below path; pattern ('*'/'?', NULL = all) filters the names shown
+FRESULT list_directory_recursive(const char *path, const char *pattern);
 DWORD get_file_size(const char *path);
 FRESULT copy_file(const char *src, const char *dst);
 FRESULT append_to_file(const char *path, const char *data);
@@ -88,11 +95,17 @@ FRESULT file_write(const char *path, const char *data);
    the FIL object (caller must f_close when done). */
 FRESULT file_open(const char *path, FIL *fil, BYTE mode);
 
+/* attach a heap-allocated cluster link map to an open file so f_lseek
+   is O(1) in disk reads. the file can't grow while it is attached;
+   call file_fastseek_release before extending it or closing it. */
+FRESULT file_fastseek(FIL *fil);
+void file_fastseek_release(FIL *fil);
+
 /* read up to `bufsize` bytes from `path` into `buffer`; 
    `*read` will be set to the actual number of bytes read. */
 FRESULT file_read(const char *path, void *buffer, UINT bufsize, UINT *read);
 
-extern uint8_t drive_present[MAX_DRIVES];
+extern uint8_t drive_present[MAX_PHYS_DRIVES];
 
 void get_full_path(const char *input, char *output);
 
@@ -100,4 +113,25 @@ size_t print_prompt(void);
 
 void normalize_path(char *path);
 
+// Print block cache size and hit/miss counters
+void print_cache_stats(void);
+
+// Write back cached data and flush every drive's write cache (1 = ok)
+int sync_all_drives(void);
+
+// Per physical drive I/O counters, then block cache hits for comparison
+void print_iostat(void);
+
+// Read/write latency histograms of one physical drive (-1 = all)
+void print_iostat_histogram(int pdrv);
+
+// Print rates, latency and utilisation every interval_ms until a key is pressed
+void iostat_watch(uint32_t interval_ms);
+
+// What every drive reported about itself and the transfer settings in use
+void print_disk_info(void);
+
+// Compare PIO and DMA read throughput on a drive ("0:".."3:", NULL = current)
+void ata_benchmark(const char *drive_spec, UINT sectors);
+
 #endif  // DISKS_H
@@ -465,6 +465,21 @@ typedef struct {	/* Open object identifier with status */
 static FATFS *FatFs[FF_VOLUMES];	/* Pointer to the filesystem objects (logical drives) */
 static WORD Fsid;					/* Filesystem mount ID */
 
+#if FF_USE_DCACHE
+#if FF_USE_LFN || (FF_USE_DCACHE & (FF_USE_DCACHE - 1))
+#error FF_USE_DCACHE must be a power of 2 and needs FF_USE_LFN = 0
+#endif
+typedef struct {	/* Path lookup cache entry */
+	WORD id;		/*  Volume mount ID (0:blank entry) */
+	BYTE neg;		/*  1:The name is known not to exist */
+	BYTE name[11];	/*  SFN of the object */
+	DWORD dclst;	/*  Containing directory (0:root) */
+	DWORD dptr;		/*  Offset of the entry in the directory */
+	DWORD sclust;	/*  Start cluster if it is a sub-directory, 0:file */
+} DCENT;
+static DCENT DirCache[FF_USE_DCACHE];	/* Path lookup cache (hashed by volume, directory and name) */
+#endif
+
 #if FF_FS_RPATH != 0
 static BYTE CurrVol;				/* Current drive number set by f_chdrive() */
 #endif
@@ -1299,6 +1314,15 @@ static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 			fs->wflag = 1;
 			break;
 		}
+#if FF_USE_FREEMAP
+		if (res == FR_OK && fs->fmap) {	/* Keep the free cluster bitmap in step */
+			if (val == 0) {
+				fs->fmap[clst / 32] |= (DWORD)1 << (clst % 32);
+			} else {
+				fs->fmap[clst / 32] &= ~((DWORD)1 << (clst % 32));
+			}
+		}
+#endif
 	}
 	return res;
 }
@@ -1308,6 +1332,130 @@ static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 
 
 
+#if FF_USE_FREEMAP && !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Build the in-memory free cluster bitmap                */
+/*-----------------------------------------------------------------------*/
+/* One bit per FAT entry, set when the cluster is free. The FAT is read
+/  once in multi-sector requests; put_fat() keeps the map up to date and
+/  create_chain()/remove_chain() keep the free cluster count. */
+
+#define FREEMAP_READ_SECT	32	/* FAT sectors per read while building the map */
+#define FREEMAP_RUN			16	/* A new fragment prefers a free run at least this long */
+
+static FRESULT build_freemap (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	DWORD *map, nfree, clst, val;
+	BYTE *buf;
+	UINT n, cnt, i, epb;
+	LBA_t sect;
+	FFOBJID obj;
+	FRESULT res = FR_OK;
+
+
+	if (fs->fmap) return FR_OK;		/* Already built */
+	map = ff_memalloc((fs->n_fatent + 31) / 32 * 4);
+	if (!map) return FR_NOT_ENOUGH_CORE;
+	memset(map, 0, (fs->n_fatent + 31) / 32 * 4);
+	nfree = 0;
+
+	if (fs->fs_type == FS_FAT12) {	/* FAT12: Entries straddle sectors, go through get_fat() */
+		obj.fs = fs;
+		for (clst = 2; clst < fs->n_fatent; clst++) {
+			val = get_fat(&obj, clst);
+			if (val == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+			if (val == 1) { res = FR_INT_ERR; break; }
+			if (val == 0) {
+				map[clst / 32] |= (DWORD)1 << (clst % 32);
+				nfree++;
+			}
+		}
+	} else {						/* FAT16/32: Read the FAT in large pieces */
+		for (n = FREEMAP_READ_SECT; (buf = ff_memalloc(n * SS(fs))) == 0 && n > 1; n /= 2) ;
+		if (!buf) {
+			ff_memfree(map);
+			return FR_NOT_ENOUGH_CORE;
+		}
+		if (sync_window(fs) != FR_OK) res = FR_DISK_ERR;	/* The window may hold a newer FAT sector */
+		epb = (fs->fs_type == FS_FAT16) ? SS(fs) / 2 : SS(fs) / 4;	/* Entries per sector */
+		clst = 0; sect = fs->fatbase;
+		while (res == FR_OK && clst < fs->n_fatent) {
+			cnt = (UINT)((fs->n_fatent - clst + epb - 1) / epb);	/* Sectors left */
+			if (cnt > n) cnt = n;
+			if (disk_read(fs->pdrv, buf, sect, cnt) != RES_OK) {
+				res = FR_DISK_ERR; break;
+			}
+			sect += cnt;
+			for (i = 0; i < cnt * epb && clst < fs->n_fatent; i++, clst++) {
+				val = (fs->fs_type == FS_FAT16) ? ld_word(buf + i * 2) : ld_dword(buf + i * 4) & 0x0FFFFFFF;
+				if (val == 0 && clst >= 2) {
+					map[clst / 32] |= (DWORD)1 << (clst % 32);
+					nfree++;
+				}
+			}
+		}
+		ff_memfree(buf);
+	}
+
+	if (res != FR_OK) {
+		ff_memfree(map);
+		return res;
+	}
+	fs->fmap = map;
+	if (fs->free_clst != nfree) {	/* Correct the count (and FSINFO at the next sync) */
+		fs->free_clst = nfree;
+		fs->fsi_flag |= 1;
+	}
+	return FR_OK;
+}
+
+
+/*--------------------------------------------------*/
+/* Find a contiguous free cluster block in the map  */
+/*--------------------------------------------------*/
+/* The scan steps over whole runs of set or clear bits at a time, so a
+/  word that is all in use or all free costs one test. */
+
+static DWORD find_freemap (	/* 0:Not found, 2..:Top of the free cluster block */
+	FATFS* fs,		/* Filesystem object */
+	DWORD scl,		/* Cluster number to start the scan from (wraps around) */
+	DWORD ncl		/* Number of contiguous clusters required */
+)
+{
+	DWORD clst, end, top, run, w;
+	UINT b, n, pass;
+
+
+	if (scl < 2 || scl >= fs->n_fatent) scl = 2;
+	for (pass = 0; pass < 2; pass++) {
+		clst = pass ? 2 : scl;			/* From the start point up, then from the top of the volume */
+		end = pass ? scl : fs->n_fatent;
+		top = run = 0;
+		while (clst < end || (run && clst < fs->n_fatent)) {	/* (a run may go on past the end) */
+			b = clst % 32;
+			w = fs->fmap[clst / 32] >> b;	/* Entries from clst to the end of the word */
+			if (w & 1) {		/* Free: take the whole run of set bits */
+				n = (~w != 0) ? (UINT)__builtin_ctz(~w) : 32;
+				if (run == 0) top = clst;
+				run += n;
+				if (run >= ncl) return top;
+			} else {			/* In use: skip the whole run of clear bits */
+				n = (w != 0) ? (UINT)__builtin_ctz(w) : 32 - b;
+				run = 0;
+			}
+			clst += n;
+		}
+	}
+	return 0;
+}
+
+#endif /* FF_USE_FREEMAP && !FF_FS_READONLY */
+
+
+
+
 #if FF_FS_EXFAT && !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* exFAT: Accessing FAT and Allocation Bitmap                            */
@@ -1588,29 +1736,45 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 #endif
 	{	/* On the FAT/FAT32 volume */
 		ncl = 0;
-		if (scl == clst) {						/* Stretching an existing chain? */
-			ncl = scl + 1;						/* Test if next cluster is free */
-			if (ncl >= fs->n_fatent) ncl = 2;
-			cs = get_fat(obj, ncl);				/* Get next cluster status */
-			if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
-			if (cs != 0) {						/* Not free? */
-				cs = fs->last_clst;				/* Start at suggested cluster if it is valid */
+#if FF_USE_FREEMAP
+		if (fs->fmap || build_freemap(fs) == FR_OK) {	/* Look the cluster up in the free cluster bitmap */
+			if (scl == clst && scl + 1 < fs->n_fatent
+				&& (fs->fmap[(scl + 1) / 32] & ((DWORD)1 << ((scl + 1) % 32)))) {
+				ncl = scl + 1;					/* The chain can stay contiguous */
+			} else {							/* Start a new fragment at the top of a free run if there is one */
+				cs = fs->last_clst;
 				if (cs >= 2 && cs < fs->n_fatent) scl = cs;
-				ncl = 0;
+				ncl = find_freemap(fs, scl, FREEMAP_RUN);
+				if (ncl == 0) ncl = find_freemap(fs, scl, 1);
+				if (ncl == 0) return 0;			/* No free cluster */
 			}
-		}
-		if (ncl == 0) {	/* The new cluster cannot be contiguous and find another fragment */
-			ncl = scl;	/* Start cluster */
-			for (;;) {
-				ncl++;							/* Next cluster */
-				if (ncl >= fs->n_fatent) {		/* Check wrap-around */
-					ncl = 2;
-					if (ncl > scl) return 0;	/* No free cluster found? */
-				}
-				cs = get_fat(obj, ncl);			/* Get the cluster status */
-				if (cs == 0) break;				/* Found a free cluster? */
+		} else
+#endif
+		{
+			if (scl == clst) {						/* Stretching an existing chain? */
+				ncl = scl + 1;						/* Test if next cluster is free */
+				if (ncl >= fs->n_fatent) ncl = 2;
+				cs = get_fat(obj, ncl);				/* Get next cluster status */
 				if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
-				if (ncl == scl) return 0;		/* No free cluster found? */
+				if (cs != 0) {						/* Not free? */
+					cs = fs->last_clst;				/* Start at suggested cluster if it is valid */
+					if (cs >= 2 && cs < fs->n_fatent) scl = cs;
+					ncl = 0;
+				}
+			}
+			if (ncl == 0) {	/* The new cluster cannot be contiguous and find another fragment */
+				ncl = scl;	/* Start cluster */
+				for (;;) {
+					ncl++;							/* Next cluster */
+					if (ncl >= fs->n_fatent) {		/* Check wrap-around */
+						ncl = 2;
+						if (ncl > scl) return 0;	/* No free cluster found? */
+					}
+					cs = get_fat(obj, ncl);			/* Get the cluster status */
+					if (cs == 0) break;				/* Found a free cluster? */
+					if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
+					if (ncl == scl) return 0;		/* No free cluster found? */
+				}
 			}
 		}
 		res = put_fat(fs, ncl, 0xFFFFFFFF);		/* Mark the new cluster 'EOC' */
@@ -1668,6 +1832,49 @@ static DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* File data - Extend a direct transfer over contiguous clusters         */
+/*-----------------------------------------------------------------------*/
+/* A direct transfer of cc sectors starting at sector csect of the current
+/  cluster would be clipped at the cluster boundary. Following clusters that
+/  are also the next ones on the disk can go in the same disk_read/write, so
+/  extend the run over them and move fp->clust to the last cluster used. */
+
+static UINT contiguous_run (	/* Number of sectors to transfer (<= cc) */
+	FIL* fp,		/* Pointer to the file object */
+	UINT csect,		/* Sector offset in the current cluster */
+	UINT cc			/* Whole sectors wanted */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	DWORD clst = fp->clust, nxt;
+	FSIZE_t ofs;
+	UINT run = fs->csize - csect;
+
+
+	if (cc <= run) return cc;
+	ofs = fp->fptr + (FSIZE_t)run * SS(fs);		/* Offset of the next cluster */
+	while (run + fs->csize <= cc) {
+#if FF_USE_FASTSEEK
+		if (fp->cltbl) {
+			nxt = clmt_clust(fp, ofs);
+		} else
+#endif
+		{
+			nxt = get_fat(&fp->obj, clst);
+		}
+		if (nxt != clst + 1) break;		/* Fragment ends (or error; the caller meets it later) */
+		clst = nxt;
+		run += fs->csize;
+		ofs += (FSIZE_t)fs->csize * SS(fs);
+	}
+	fp->clust = clst;
+	return run;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Fill a cluster with zeros                        */
 /*-----------------------------------------------------------------------*/
@@ -2479,6 +2686,104 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 
 
 
+#if FF_USE_DCACHE
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Path lookup cache                                */
+/*-----------------------------------------------------------------------*/
+/* One entry per (volume, directory, name), holding where dir_find() found
+/  the name or that it did not. A hit on a sub-directory in the middle of a
+/  path needs no disk access at all; a hit on the last segment loads just
+/  the sector of the entry and checks that the name is still there. */
+
+static DCENT* dcache_slot (	/* Pointer to the cache entry for the name */
+	FATFS* fs,				/* Filesystem object */
+	DWORD dclst,			/* Containing directory */
+	const BYTE* name		/* SFN */
+)
+{
+	DWORD h = fs->id + dclst * 31;
+	UINT i;
+
+
+	for (i = 0; i < 11; i++) h = h * 31 + name[i];
+	return &DirCache[h % FF_USE_DCACHE];
+}
+
+
+static int dcache_match (	/* 1:The entry holds the name */
+	const DCENT* e,
+	FATFS* fs,
+	DWORD dclst,
+	const BYTE* name
+)
+{
+	return e->id != 0 && e->id == fs->id && e->dclst == dclst && !memcmp(e->name, name, 11);
+}
+
+
+static void dcache_drop (	/* Forget a name (it has been created or removed) */
+	FATFS* fs,
+	DWORD dclst,
+	const BYTE* name
+)
+{
+	DCENT *e = dcache_slot(fs, dclst, name);
+
+
+	if (dcache_match(e, fs, dclst, name)) e->id = 0;
+}
+
+
+static DWORD dcache_subdir (	/* Start cluster of the sub-directory dp->fn, 0:not cached */
+	DIR* dp
+)
+{
+	FATFS *fs = dp->obj.fs;
+	DCENT *e = dcache_slot(fs, dp->obj.sclust, dp->fn);
+
+
+	return (dcache_match(e, fs, dp->obj.sclust, dp->fn) && !e->neg) ? e->sclust : 0;
+}
+
+
+static FRESULT dcache_find (	/* dir_find() through the path lookup cache */
+	DIR* dp
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	DCENT *e = dcache_slot(fs, dp->obj.sclust, dp->fn);
+
+
+	if (dcache_match(e, fs, dp->obj.sclust, dp->fn)) {
+		if (e->neg) return FR_NO_FILE;
+		res = dir_sdi(dp, e->dptr);		/* Go straight to the entry */
+		if (res == FR_OK) res = move_window(fs, dp->sect);
+		if (res != FR_OK) return res;
+		if (dp->dir[DIR_Name] != DDEM && !(dp->dir[DIR_Attr] & AM_VOL) && !memcmp(dp->dir, dp->fn, 11)) {
+			dp->obj.attr = dp->dir[DIR_Attr] & AM_MASK;
+			return FR_OK;
+		}
+		e->id = 0;						/* Stale, look it up again */
+	}
+
+	res = dir_find(dp);
+	if (res == FR_OK || res == FR_NO_FILE) {
+		e->id = fs->id;
+		e->neg = (res == FR_NO_FILE);
+		memcpy(e->name, dp->fn, 11);
+		e->dclst = dp->obj.sclust;
+		e->dptr = dp->dptr;
+		e->sclust = (res == FR_OK && (dp->obj.attr & AM_DIR)) ? ld_clust(fs, dp->dir) : 0;
+	}
+	return res;
+}
+
+#endif	/* FF_USE_DCACHE */
+
+
+
+
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* Register an object to the directory                                   */
@@ -2575,6 +2880,10 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 			dp->dir[DIR_NTres] = dp->fn[NSFLAG] & (NS_BODY | NS_EXT);	/* Put NT flag */
 #endif
 			fs->wflag = 1;
+			fs->dir_mod++;
+#if FF_USE_DCACHE
+			dcache_drop(fs, dp->obj.sclust, dp->fn);	/* It is no longer missing */
+#endif
 		}
 	}
 
@@ -2619,10 +2928,14 @@ static FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 
 	res = move_window(fs, dp->sect);
 	if (res == FR_OK) {
+#if FF_USE_DCACHE
+		dcache_drop(fs, dp->obj.sclust, dp->dir);	/* Forget where it was */
+#endif
 		dp->dir[DIR_Name] = DDEM;	/* Mark the entry 'deleted'.*/
 		fs->wflag = 1;
 	}
 #endif
+	if (res == FR_OK) fs->dir_mod++;
 
 	return res;
 }
@@ -3114,7 +3427,19 @@ static FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 		for (;;) {
 			res = create_name(dp, &path);	/* Get a segment name of the path */
 			if (res != FR_OK) break;
+#if FF_USE_DCACHE
+			if (!(dp->fn[NSFLAG] & NS_LAST)) {	/* A known sub-directory on the way: step into it */
+				DWORD scl = dcache_subdir(dp);
+
+				if (scl != 0) {
+					dp->obj.sclust = scl;
+					continue;
+				}
+			}
+			res = dcache_find(dp);			/* Find an object with the segment name */
+#else
 			res = dir_find(dp);				/* Find an object with the segment name */
+#endif
 			ns = dp->fn[NSFLAG];
 			if (res != FR_OK) {				/* Failed to find the object */
 				if (res == FR_NO_FILE) {	/* Object is not found */
@@ -3441,6 +3766,10 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 	/* Following code attempts to mount the volume. (find an FAT volume, analyze the BPB and initialize the filesystem object) */
 
 	fs->fs_type = 0;					/* Invalidate the filesystem object */
+#if FF_USE_FREEMAP && !FF_FS_READONLY
+	ff_memfree(fs->fmap);				/* The free cluster bitmap is rebuilt for the new volume */
+	fs->fmap = 0;
+#endif
 	stat = disk_initialize(fs->pdrv);	/* Initialize the volume hosting physical drive */
 	if (stat & STA_NOINIT) { 			/* Check if the initialization succeeded */
 		return FR_NOT_READY;			/* Failed to initialize due to no medium or hard error */
@@ -3695,6 +4024,10 @@ FRESULT f_mount (
 		ff_mutex_delete(vol);
 #endif
 		cfs->fs_type = 0;		/* Invalidate the filesystem object to be unregistered */
+#if FF_USE_FREEMAP && !FF_FS_READONLY
+		ff_memfree(cfs->fmap);	/* Discard the free cluster bitmap */
+		cfs->fmap = 0;
+#endif
 	}
 
 	if (fs) {					/* Register new filesystem object */
@@ -3713,6 +4046,9 @@ FRESULT f_mount (
 #endif
 #endif
 		fs->fs_type = 0;		/* Invalidate the new filesystem object */
+#if FF_USE_FREEMAP && !FF_FS_READONLY
+		if (fs != cfs) fs->fmap = 0;	/* No bitmap until the first scan */
+#endif
 		FatFs[vol] = fs;		/* Register new fs object */
 	}
 
@@ -3814,6 +4150,7 @@ FRESULT f_open (
 					st_clust(fs, dj.dir, 0);			/* Reset file allocation info */
 					st_dword(dj.dir + DIR_FileSize, 0);
 					fs->wflag = 1;
+					fs->dir_mod++;
 					if (cl != 0) {						/* Remove the cluster chain if exist */
 						sc = fs->winsect;
 						res = remove_chain(&dj.obj, cl, 0);
@@ -3974,9 +4311,7 @@ FRESULT f_read (
 			sect += csect;
 			cc = btr / SS(fs);					/* When remaining bytes >= sector size, */
 			if (cc > 0) {						/* Read maximum contiguous sectors directly */
-				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
-					cc = fs->csize - csect;
-				}
+				cc = contiguous_run(fp, csect, cc);	/* Clip at the end of the contiguous clusters */
 				if (disk_read(fs->pdrv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2		/* Replace one of the read sectors with cached data if it contains a dirty sector */
 #if FF_FS_TINY
@@ -4089,9 +4424,7 @@ FRESULT f_write (
 			sect += csect;
 			cc = btw / SS(fs);				/* When remaining bytes >= sector size, */
 			if (cc > 0) {					/* Write maximum contiguous sectors directly */
-				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
-					cc = fs->csize - csect;
-				}
+				cc = contiguous_run(fp, csect, cc);	/* Clip at the end of the contiguous clusters */
 				if (disk_write(fs->pdrv, wbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if FF_FS_MINIMIZE <= 2
 #if FF_FS_TINY
@@ -4209,6 +4542,7 @@ FRESULT f_sync (
 					st_dword(dir + DIR_ModTime, tm);				/* Update modified time */
 					st_word(dir + DIR_LstAccDate, 0);
 					fs->wflag = 1;
+					fs->dir_mod++;
 					res = sync_fs(fs);					/* Restore it to the directory */
 					fp->flag &= (BYTE)~FA_MODIFIED;
 				}
@@ -4849,7 +5183,13 @@ FRESULT f_getfree (
 		/* If free_clst is valid, return it without full FAT scan */
 		if (fs->free_clst <= fs->n_fatent - 2) {
 			*nclst = fs->free_clst;
-		} else {
+		} else
+#if FF_USE_FREEMAP && !FF_FS_READONLY
+		if (build_freemap(fs) == FR_OK) {	/* Building the bitmap counts the free clusters too */
+			*nclst = fs->free_clst;
+		} else
+#endif
+		{
 			/* Scan FAT to obtain the correct free cluster count */
 			nfree = 0;
 			if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
@@ -5291,6 +5631,7 @@ FRESULT f_chmod (
 			{
 				dj.dir[DIR_Attr] = (attr & mask) | (dj.dir[DIR_Attr] & (BYTE)~mask);	/* Apply attribute change */
 				fs->wflag = 1;
+				fs->dir_mod++;
 			}
 			if (res == FR_OK) {
 				res = sync_fs(fs);
@@ -5336,6 +5677,7 @@ FRESULT f_utime (
 			{
 				st_dword(dj.dir + DIR_ModTime, (DWORD)fno->fdate << 16 | fno->ftime);
 				fs->wflag = 1;
+				fs->dir_mod++;
 			}
 			if (res == FR_OK) {
 				res = sync_fs(fs);
@@ -5618,23 +5960,31 @@ FRESULT f_expand (
 	} else
 #endif
 	{
-		scl = clst = stcl; ncl = 0;
-		for (;;) {	/* Find a contiguous cluster block */
-			n = get_fat(&fp->obj, clst);
-			if (++clst >= fs->n_fatent) clst = 2;
-			if (n == 1) {
-				res = FR_INT_ERR; break;
-			}
-			if (n == 0xFFFFFFFF) {
-				res = FR_DISK_ERR; break;
-			}
-			if (n == 0) {	/* Is it a free cluster? */
-				if (++ncl == tcl) break;	/* Break if a contiguous cluster block is found */
-			} else {
-				scl = clst; ncl = 0;		/* Not a free cluster */
-			}
-			if (clst == stcl) {		/* No contiguous cluster? */
-				res = FR_DENIED; break;
+#if FF_USE_FREEMAP
+		if (fs->fmap || build_freemap(fs) == FR_OK) {	/* Find the block in the free cluster bitmap */
+			scl = find_freemap(fs, stcl, tcl);
+			if (scl == 0) res = FR_DENIED;		/* No contiguous cluster block was found */
+		} else
+#endif
+		{
+			scl = clst = stcl; ncl = 0;
+			for (;;) {	/* Find a contiguous cluster block */
+				n = get_fat(&fp->obj, clst);
+				if (++clst >= fs->n_fatent) clst = 2;
+				if (n == 1) {
+					res = FR_INT_ERR; break;
+				}
+				if (n == 0xFFFFFFFF) {
+					res = FR_DISK_ERR; break;
+				}
+				if (n == 0) {	/* Is it a free cluster? */
+					if (++ncl == tcl) break;	/* Break if a contiguous cluster block is found */
+				} else {
+					scl = clst; ncl = 0;		/* Not a free cluster */
+				}
+				if (clst == stcl) {		/* No contiguous cluster? */
+					res = FR_DENIED; break;
+				}
 			}
 		}
 		if (res == FR_OK) {	/* A contiguous free area is found */
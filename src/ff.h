@@ -153,6 +153,10 @@ typedef struct {
 	DWORD	last_clst;		/* Last allocated cluster (Unknown if >= n_fatent) */
 	DWORD	free_clst;		/* Number of free clusters (Unknown if >= n_fatent-2) */
 #endif
+#if FF_USE_FREEMAP && !FF_FS_READONLY
+	DWORD*	fmap;			/* Free cluster bitmap (1:free, null:not built yet) */
+#endif
+	DWORD	dir_mod;		/* Directory change counter (incremented on every directory entry update) */
 #if FF_FS_RPATH
 	DWORD	cdir;			/* Current directory start cluster (0:root) */
 #if FF_FS_EXFAT
@@ -372,7 +376,7 @@ DWORD ff_wtoupper (DWORD uni);			/* Unicode upper-case conversion */
 
 /* O/S dependent functions (samples available in ffsystem.c) */
 
-#if FF_USE_LFN == 3		/* Dynamic memory allocation */
+#if FF_USE_LFN == 3 || FF_USE_FREEMAP	/* Dynamic memory allocation */
 void* ff_memalloc (UINT msize);		/* Allocate memory block */
 void ff_memfree (void* mblock);		/* Free memory block */
 #endif
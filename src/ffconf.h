@@ -34,14 +34,32 @@
 /* This option switches f_mkfs(). (0:Disable or 1:Enable) */
 
 
-#define FF_USE_FASTSEEK	0
+#define FF_USE_FASTSEEK	1
 /* This option switches fast seek feature. (0:Disable or 1:Enable) */
 
 
-#define FF_USE_EXPAND	0
+#define FF_USE_EXPAND	1
 /* This option switches f_expand(). (0:Disable or 1:Enable) */
 
 
+#define FF_USE_FREEMAP	1
+/* This option switches the in-memory free cluster bitmap. The FAT is read once
+/  after the volume is mounted, at the first f_getfree() or cluster allocation
+/  that needs it, and the bitmap and the free cluster count are kept up to date from
+/  then on. Cluster allocation (create_chain() and f_expand()) searches the
+/  bitmap instead of the FAT and starts new fragments at the top of a free run.
+/  ff_memalloc() and ff_memfree() need to be added to the project.
+/  (0:Disable or 1:Enable) */
+
+
+#define FF_USE_DCACHE	256
+/* This option sets the number of entries in the path lookup cache. It remembers
+/  where each name was found in its directory, or that it was not found, so that
+/  repeated lookups of the same paths skip the directory scans. Entries are
+/  dropped when names are created or removed and on every mount.
+/  (0:Disable or a power of 2) It works only with FF_USE_LFN = 0. */
+
+
 #define FF_USE_CHMOD	0
 /* This option switches attribute control API functions, f_chmod() and f_utime().
 /  (0:Disable or 1:Enable) Also FF_FS_READONLY needs to be 0 to enable this option. */
@@ -166,7 +184,7 @@
 / Drive/Volume Configurations
 /---------------------------------------------------------------------------*/
 
-#define FF_VOLUMES		1
+#define FF_VOLUMES		4
 /* Number of volumes (logical drives) to be used. (1-10) */
 
 
@@ -0,0 +1,30 @@
+/*------------------------------------------------------------------------*/
+/* OS Dependent Functions for FatFs                                       */
+/*------------------------------------------------------------------------*/
+
+#include "ff.h"
+#include "stdlib.h"
+
+
+#if FF_USE_LFN == 3 || FF_USE_FREEMAP	/* Use dynamic memory allocation */
+
+/*------------------------------------------------------------------------*/
+/* Allocate/Free a Memory Block                                           */
+/*------------------------------------------------------------------------*/
+
+void* ff_memalloc (	/* Returns pointer to the allocated memory block (null if not enough core) */
+	UINT msize		/* Number of bytes to allocate */
+)
+{
+	return malloc((size_t)msize);	/* Allocate a new memory block from the kernel heap */
+}
+
+
+void ff_memfree (
+	void* mblock	/* Pointer to the memory block to free (no effect if null) */
+)
+{
+	free(mblock);	/* Free the memory block */
+}
+
+#endif
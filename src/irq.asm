@@ -0,0 +1,110 @@
+# Copyright (c) Turrnut Open Source Organization
+# Under the GPL v3 License
+# See COPYING for information on how you can use this file
+#
+# irq.asm
+#
+
+.section .text
+.global timer_handler
+.global ata_primary_handler
+.global ata_secondary_handler
+.extern pit_tick_increment
+.extern irq_ata_handler_c
+.extern irq_dispatch_c
+.global irq_stub_table
+
+# -------------------------------
+# PIT channel 0 (IRQ0), 1 ms tick
+# -------------------------------
+timer_handler:
+    pusha
+    cld
+
+    call pit_tick_increment
+
+    movb $0x20, %al          # EOI to master PIC
+    outb %al, $0x20
+
+    popa
+    iret
+
+# -------------------------------
+# primary IDE channel (IRQ14)
+# -------------------------------
+ata_primary_handler:
+    pusha
+    cld
+
+    push $0
+    call irq_ata_handler_c
+    add $4, %esp
+
+    movb $0x20, %al          # EOI to slave, then master PIC
+    outb %al, $0xA0
+    outb %al, $0x20
+
+    popa
+    iret
+
+# -------------------------------
+# secondary IDE channel (IRQ15)
+# -------------------------------
+ata_secondary_handler:
+    pusha
+    cld
+
+    push $1
+    call irq_ata_handler_c
+    add $4, %esp
+
+    movb $0x20, %al          # EOI to slave, then master PIC
+    outb %al, $0xA0
+    outb %al, $0x20
+
+    popa
+    iret
+
+# -------------------------------
+# IRQ3..IRQ13: lines PCI devices may be routed to. each stub passes its
+# IRQ number to irq_dispatch_c (pic.c), which calls whatever drivers
+# installed themselves on that line
+# -------------------------------
+.macro IRQ_STUB n
+irq\n\()_handler:
+    pusha
+    cld
+
+    push $\n
+    call irq_dispatch_c
+    add $4, %esp
+
+    movb $0x20, %al
+.if \n >= 8
+    outb %al, $0xA0          # EOI to slave PIC as well
+.endif
+    outb %al, $0x20
+
+    popa
+    iret
+.endm
+
+IRQ_STUB 3
+IRQ_STUB 4
+IRQ_STUB 5
+IRQ_STUB 6
+IRQ_STUB 7
+IRQ_STUB 8
+IRQ_STUB 9
+IRQ_STUB 10
+IRQ_STUB 11
+IRQ_STUB 12
+IRQ_STUB 13
+
+# vectors 0x23..0x2D, installed by setup_idt in boot.asm
+.section .data
+.align 4
+irq_stub_table:
+    .long irq3_handler, irq4_handler, irq5_handler, irq6_handler
+    .long irq7_handler, irq8_handler, irq9_handler, irq10_handler
+    .long irq11_handler, irq12_handler, irq13_handler
@@ -13,6 +13,7 @@
  #include "string.h"
  #include "command.h"
  #include "disks.h"
+ #include "bcache.h"
  #include <stdint.h>
 
  int accept_key_presses = 0;
@@ -229,6 +230,8 @@ int getch() {
         if (scan_dequeue(&scancode)) {
             code = capitalize_if_shift(scancode_to_ascii(scancode));
             if (code != 0) return code;
+        } else {
+            bcache_idle();  // waiting on the user is a good time to write back
         }
     }
 }
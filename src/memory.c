@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ * 
+ * memory.c
+ */
+
+#include "memory.h"
+#include "multiboot.h"
+#include <stdint.h>
+
+// start of the (otherwise unused) .heap section in link.ld: everything from
+// here to the top of upper memory is free RAM
+extern uint8_t __heap_start;
+
+// README asks for at least 16 MB; assume that if GRUB didn't tell us
+#define DEFAULT_UPPER_KB (15 * 1024)
+
+static uint32_t lower_kb = 640;
+static uint32_t upper_kb = DEFAULT_UPPER_KB;
+
+static uintptr_t high_next = 0;
+static uintptr_t high_end  = 0;
+
+#define MAX_BOOT_MODULES 4
+
+typedef struct {
+    uint32_t start;
+    uint32_t size;
+    char     name[BOOT_MODULE_NAME_LEN];
+} boot_module_t;
+
+static boot_module_t modules[MAX_BOOT_MODULES];
+static int module_count = 0;
+
+// copy the module list while GRUB's tables are still intact; they may
+// sit in memory high_alloc is about to hand out
+static uintptr_t modules_detect(uintptr_t end) {
+    if (!mb_info || !(mb_info->flags & MULTIBOOT_INFO_MODS)) return end;
+
+    const multiboot_module_t *mods = (const multiboot_module_t *)mb_info->mods_addr;
+    for (uint32_t i = 0; i < mb_info->mods_count && module_count < MAX_BOOT_MODULES; i++) {
+        if (mods[i].mod_end <= mods[i].mod_start) continue;
+
+        boot_module_t *m = &modules[module_count++];
+        m->start = mods[i].mod_start;
+        m->size  = mods[i].mod_end - mods[i].mod_start;
+
+        // the "module" line is the file name followed by its arguments; keep the arguments
+        const char *s = (const char *)mods[i].string;
+        int n = 0;
+        if (s) {
+            while (*s && *s != ' ') s++;
+            while (*s == ' ') s++;
+            while (s[n] && n < BOOT_MODULE_NAME_LEN - 1) {
+                m->name[n] = s[n];
+                n++;
+            }
+        }
+        m->name[n] = '\0';
+
+        if (mods[i].mod_end > end) end = mods[i].mod_end;
+    }
+    return end;
+}
+
+void memory_detect(void) {
+    if (mb_info && (mb_info->flags & MULTIBOOT_INFO_MEMORY)) {
+        lower_kb = mb_info->mem_lower;
+        upper_kb = mb_info->mem_upper;
+    }
+
+    // GRUB puts modules right behind the kernel image
+    module_count = 0;
+    high_next = modules_detect((uintptr_t)&__heap_start);
+    high_next = (high_next + 0xFFF) & ~(uintptr_t)0xFFF;
+    high_end  = 0x100000 + (uintptr_t)upper_kb * 1024;
+    if (high_end < high_next) {
+        high_end = high_next;
+    }
+}
+
+uint32_t memory_total_kb(void) {
+    return lower_kb + upper_kb;
+}
+
+size_t high_available(void) {
+    if (!high_next) memory_detect();
+    return high_end - high_next;
+}
+
+void* high_alloc(size_t size, size_t align) {
+    if (!high_next) memory_detect();
+    if (align == 0) align = 1;
+
+    uintptr_t p = (high_next + (align - 1)) & ~(uintptr_t)(align - 1);
+    if (p < high_next || p > high_end || size > high_end - p) {
+        return NULL;
+    }
+
+    high_next = p + size;
+    return (void*)p;
+}
+
+int boot_module_count(void) {
+    if (!high_next) memory_detect();
+    return module_count;
+}
+
+const uint8_t* boot_module(int i, uint32_t *size, const char **name) {
+    if (i < 0 || i >= boot_module_count()) return NULL;
+    if (size) *size = modules[i].size;
+    if (name) *name = modules[i].name;
+    return (const uint8_t *)modules[i].start;
+}
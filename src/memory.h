@@ -0,0 +1,39 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ * 
+ * memory.h
+ */
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Read the memory size from the multiboot info. Call once at boot.
+void memory_detect(void);
+
+// Total RAM in KB (lower + upper memory)
+uint32_t memory_total_kb(void);
+
+// Bytes still free above the kernel image
+size_t high_available(void);
+
+// Carve a permanent, aligned block out of RAM above the kernel image.
+// For big long-lived buffers (caches, RAM disks) that would not fit in the
+// malloc heap. There is no free; returns NULL when memory runs out.
+void* high_alloc(size_t size, size_t align);
+
+// Files GRUB loaded next to the kernel ("module" lines in grub.cfg).
+// Their memory is kept out of high_alloc's way.
+#define BOOT_MODULE_NAME_LEN 32
+
+int boot_module_count(void);
+
+// Start of module i, its size in bytes and the text after the file name
+// on its "module" line. Returns NULL if there is no such module.
+const uint8_t* boot_module(int i, uint32_t *size, const char **name);
+
+#endif // MEMORY_H
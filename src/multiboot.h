@@ -0,0 +1,43 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ * 
+ * multiboot.h
+ */
+
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include <stdint.h>
+
+// flags telling which multiboot_info_t fields GRUB filled in
+#define MULTIBOOT_INFO_MEMORY 0x00000001  // mem_lower / mem_upper
+#define MULTIBOOT_INFO_MODS   0x00000008  // mods_count / mods_addr
+
+// Multiboot (v1) information structure, as handed over in %ebx
+typedef struct {
+    uint32_t flags;
+    uint32_t mem_lower;    // KB of memory below 1 MB
+    uint32_t mem_upper;    // KB of contiguous memory above 1 MB
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+} __attribute__((packed)) multiboot_info_t;
+
+// one entry of the mods_addr array: a file GRUB loaded with "module"
+typedef struct {
+    uint32_t mod_start;    // first byte
+    uint32_t mod_end;      // one past the last byte
+    uint32_t string;       // the rest of the "module" line, NUL terminated
+    uint32_t reserved;
+} __attribute__((packed)) multiboot_module_t;
+
+// saved by boot.asm
+extern multiboot_info_t *mb_info;
+
+#endif // MULTIBOOT_H
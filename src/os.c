@@ -18,6 +18,7 @@
 #include "ff.h"  // Include FatFs header
 #include "stdlib.h"  // For memory management functions
 #include "disks.h"
+#include "memory.h"
 
 // Declare a FAT file system object and a file object
 FATFS fs;     // File system object
@@ -71,6 +72,7 @@ static unsigned char logo[] = {
 
 void start() {
     pit_init_for_polling();
+    memory_detect();
 
     clear_screen();
     set_color(15, 0);
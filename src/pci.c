@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ * 
+ * pci.c
+ */
+
+#include "pci.h"
+#include "port.h"
+#include <stdint.h>
+
+// configuration mechanism #1
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+static uint32_t pci_address(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    return 0x80000000u
+         | ((uint32_t)bus << 16)
+         | ((uint32_t)(slot & 0x1F) << 11)
+         | ((uint32_t)(func & 0x07) << 8)
+         | (offset & 0xFC);
+}
+
+uint32_t pci_config_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint16_t pci_config_read16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    uint32_t v = pci_config_read32(bus, slot, func, offset);
+    return (uint16_t)(v >> ((offset & 2) * 8));
+}
+
+uint8_t pci_config_read8(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    uint32_t v = pci_config_read32(bus, slot, func, offset);
+    return (uint8_t)(v >> ((offset & 3) * 8));
+}
+
+void pci_config_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+// 16-bit access on the data port, so writing the command register never
+// writes back (and clears) the RW1C status bits next to it
+void pci_config_write16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint16_t value) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, func, offset));
+    outw(PCI_CONFIG_DATA + (offset & 2), value);
+}
+
+static void pci_fill(pci_device_t *dev, uint8_t bus, uint8_t slot, uint8_t func) {
+    dev->bus        = bus;
+    dev->slot       = slot;
+    dev->func       = func;
+    dev->vendor_id  = pci_config_read16(bus, slot, func, PCI_VENDOR_ID);
+    dev->device_id  = pci_config_read16(bus, slot, func, PCI_DEVICE_ID);
+    dev->class_code = pci_config_read8(bus, slot, func, PCI_CLASS);
+    dev->subclass   = pci_config_read8(bus, slot, func, PCI_SUBCLASS);
+    dev->prog_if    = pci_config_read8(bus, slot, func, PCI_PROG_IF);
+    dev->irq_line   = pci_config_read8(bus, slot, func, PCI_INTERRUPT_LINE);
+}
+
+// brute-force scan of every bus/slot/function for the index'th function
+// whose class/subclass (by_id = 0) or vendor/device ID (by_id = 1) match
+static int pci_find(int by_id, uint16_t a, uint16_t b, int index, pci_device_t *dev) {
+    for (int bus = 0; bus < 256; bus++) {
+        for (int slot = 0; slot < 32; slot++) {
+            if (pci_config_read16(bus, slot, 0, PCI_VENDOR_ID) == 0xFFFF) continue;
+
+            // only probe functions 1..7 on multi-function devices
+            int nfunc = (pci_config_read8(bus, slot, 0, PCI_HEADER_TYPE) & 0x80) ? 8 : 1;
+            for (int func = 0; func < nfunc; func++) {
+                uint16_t vendor = pci_config_read16(bus, slot, func, PCI_VENDOR_ID);
+                if (vendor == 0xFFFF) continue;
+                if (by_id) {
+                    if (vendor != a) continue;
+                    if (pci_config_read16(bus, slot, func, PCI_DEVICE_ID) != b) continue;
+                } else {
+                    if (pci_config_read8(bus, slot, func, PCI_CLASS) != a) continue;
+                    if (pci_config_read8(bus, slot, func, PCI_SUBCLASS) != b) continue;
+                }
+
+                if (index-- == 0) {
+                    pci_fill(dev, bus, slot, func);
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int pci_find_class(uint8_t class_code, uint8_t subclass, int index, pci_device_t *dev) {
+    return pci_find(0, class_code, subclass, index, dev);
+}
+
+int pci_find_device(uint16_t vendor_id, uint16_t device_id, int index, pci_device_t *dev) {
+    return pci_find(1, vendor_id, device_id, index, dev);
+}
+
+uint32_t pci_read_bar(const pci_device_t *dev, int n) {
+    uint32_t bar = pci_config_read32(dev->bus, dev->slot, dev->func, PCI_BAR0 + n * 4);
+    if (bar & 0x01) {
+        return bar & 0xFFFFFFFCu;  // I/O space
+    }
+    return bar & 0xFFFFFFF0u;      // memory space
+}
+
+void pci_enable(const pci_device_t *dev, uint16_t cmd_bits) {
+    uint16_t cmd = pci_config_read16(dev->bus, dev->slot, dev->func, PCI_COMMAND);
+    pci_config_write16(dev->bus, dev->slot, dev->func, PCI_COMMAND, cmd | cmd_bits);
+}
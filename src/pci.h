@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ * 
+ * pci.h
+ */
+
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+// Configuration space registers (type 0 header)
+#define PCI_VENDOR_ID      0x00
+#define PCI_DEVICE_ID      0x02
+#define PCI_COMMAND        0x04
+#define PCI_STATUS         0x06
+#define PCI_PROG_IF        0x09
+#define PCI_SUBCLASS       0x0A
+#define PCI_CLASS          0x0B
+#define PCI_HEADER_TYPE    0x0E
+#define PCI_BAR0           0x10
+#define PCI_INTERRUPT_LINE 0x3C
+
+// Command register bits
+#define PCI_CMD_IO_SPACE   0x0001
+#define PCI_CMD_MEM_SPACE  0x0002
+#define PCI_CMD_BUS_MASTER 0x0004
+
+// Class codes we care about
+#define PCI_CLASS_STORAGE  0x01
+#define PCI_SUBCLASS_IDE   0x01
+#define PCI_SUBCLASS_SATA  0x06
+
+typedef struct {
+    uint8_t  bus;
+    uint8_t  slot;
+    uint8_t  func;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t  class_code;
+    uint8_t  subclass;
+    uint8_t  prog_if;
+    uint8_t  irq_line;
+} pci_device_t;
+
+uint32_t pci_config_read32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+uint16_t pci_config_read16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+uint8_t  pci_config_read8(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset);
+void     pci_config_write32(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value);
+void     pci_config_write16(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint16_t value);
+
+// Find the index'th function with the given class/subclass (0 = first).
+// Returns 1 and fills *dev if found, 0 otherwise.
+int pci_find_class(uint8_t class_code, uint8_t subclass, int index, pci_device_t *dev);
+
+// Same, by vendor and device ID
+int pci_find_device(uint16_t vendor_id, uint16_t device_id, int index, pci_device_t *dev);
+
+// Read BAR n (0..5). I/O BARs come back as a port number, memory BARs as
+// an address, with the type bits masked off either way.
+uint32_t pci_read_bar(const pci_device_t *dev, int n);
+
+// Set bits in the command register (e.g. PCI_CMD_BUS_MASTER)
+void pci_enable(const pci_device_t *dev, uint16_t cmd_bits);
+
+#endif // PCI_H
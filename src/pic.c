@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ * 
+ * pic.c
+ */
+
+#include "pic.h"
+#include "port.h"
+#include <stdint.h>
+
+#define PIC_MASTER_DATA 0x21
+#define PIC_SLAVE_DATA  0xA1
+
+// irq.asm has stubs for these lines only
+#define IRQ_FIRST       3
+#define IRQ_LAST        13
+#define IRQ_MAX_SHARED  4
+
+typedef struct {
+    irq_handler_t fn;
+    void *ctx;
+} irq_entry_t;
+
+static irq_entry_t irq_handlers[IRQ_LAST + 1][IRQ_MAX_SHARED];
+
+static void pic_unmask(uint8_t irq) {
+    if (irq < 8) {
+        outb(PIC_MASTER_DATA, inb(PIC_MASTER_DATA) & ~(1u << irq));
+    } else {
+        outb(PIC_SLAVE_DATA, inb(PIC_SLAVE_DATA) & ~(1u << (irq - 8)));
+        outb(PIC_MASTER_DATA, inb(PIC_MASTER_DATA) & ~(1u << 2));  // cascade
+    }
+}
+
+int irq_install(uint8_t irq, irq_handler_t fn, void *ctx) {
+    if (irq < IRQ_FIRST || irq > IRQ_LAST || !fn) return -1;
+
+    for (int i = 0; i < IRQ_MAX_SHARED; i++) {
+        if (irq_handlers[irq][i].fn) continue;
+
+        asm volatile ("cli");
+        irq_handlers[irq][i].ctx = ctx;
+        irq_handlers[irq][i].fn  = fn;
+        pic_unmask(irq);
+        asm volatile ("sti");
+        return 0;
+    }
+    return -1;
+}
+
+void irq_dispatch_c(uint32_t irq) {
+    if (irq < IRQ_FIRST || irq > IRQ_LAST) return;
+
+    for (int i = 0; i < IRQ_MAX_SHARED; i++) {
+        if (irq_handlers[irq][i].fn) {
+            irq_handlers[irq][i].fn(irq_handlers[irq][i].ctx);
+        }
+    }
+}
@@ -0,0 +1,27 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ * 
+ * pic.h
+ */
+
+#ifndef PIC_H
+#define PIC_H
+
+#include <stdint.h>
+
+// Handlers for IRQ3..IRQ13, the lines PCI devices get routed to. PCI
+// interrupts are level triggered and may be shared, so a line can carry
+// several handlers; each must check (and acknowledge) its own device.
+
+typedef void (*irq_handler_t)(void *ctx);
+
+// Install fn on the line and unmask it. Returns 0, or -1 if the line has
+// no stub or no room for another handler.
+int irq_install(uint8_t irq, irq_handler_t fn, void *ctx);
+
+// Called from the stubs in irq.asm
+void irq_dispatch_c(uint32_t irq);
+
+#endif // PIC_H
@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ * 
+ * ramdisk.c
+ */
+
+#include "ramdisk.h"
+#include "memory.h"     // high_alloc, boot modules
+#include "string.h"
+#include <stdint.h>
+
+#define RAMDISK_MAX_UNITS  4
+#define RAMDISK_MIN_SECTORS 128   // 64 KB: about the smallest FAT12 f_mkfs accepts
+
+typedef struct {
+    BYTE    *data;
+    uint32_t sectors;
+    uint8_t  read_only;
+} ramdisk_t;
+
+static ramdisk_t disks[RAMDISK_MAX_UNITS];
+static int disk_count = 0;
+static int modules_attached = 0;
+
+int ramdisk_create(uint32_t sectors) {
+    if (disk_count >= RAMDISK_MAX_UNITS) return -1;
+    if (sectors < RAMDISK_MIN_SECTORS) return -1;
+    if (sectors > high_available() / 512) return -1;
+
+    BYTE *data = high_alloc((size_t)sectors * 512, 512);
+    if (!data) return -1;
+    memset(data, 0, (size_t)sectors * 512);
+
+    return ramdisk_attach(data, sectors, 0);
+}
+
+int ramdisk_attach(const BYTE *data, uint32_t sectors, int read_only) {
+    if (disk_count >= RAMDISK_MAX_UNITS || !data || sectors == 0) return -1;
+
+    // writes are refused for read-only units, so the cast is never acted on
+    disks[disk_count].data = (BYTE *)data;
+    disks[disk_count].sectors = sectors;
+    disks[disk_count].read_only = read_only ? 1 : 0;
+    return disk_count++;
+}
+
+// a FAT boot sector ends in 55 AA and starts with a jump instruction
+static int looks_like_fat(const BYTE *sec) {
+    if (sec[510] != 0x55 || sec[511] != 0xAA) return 0;
+    return sec[0] == 0xEB || sec[0] == 0xE9;
+}
+
+int ramdisk_attach_modules(void) {
+    if (modules_attached) return 0;
+    modules_attached = 1;
+
+    int added = 0;
+    for (int i = 0; i < boot_module_count(); i++) {
+        uint32_t size;
+        const uint8_t *data = boot_module(i, &size, NULL);
+        if (size < 512 || !looks_like_fat(data)) continue;  // not a disk image
+
+        if (ramdisk_attach(data, size / 512, 1) < 0) break;
+        added++;
+    }
+    return added;
+}
+
+int ramdisk_count(void) {
+    return disk_count;
+}
+
+uint32_t ramdisk_sectors(BYTE unit) {
+    return (unit < disk_count) ? disks[unit].sectors : 0;
+}
+
+int ramdisk_read_only(BYTE unit) {
+    return (unit < disk_count) ? disks[unit].read_only : 0;
+}
+
+//------------------------------------------------------------
+// Block device interface (diskio.c)
+//------------------------------------------------------------
+static ramdisk_t* ramdisk_unit(BYTE unit, LBA_t sector, UINT count) {
+    if (unit >= disk_count) return NULL;
+    ramdisk_t *d = &disks[unit];
+    if (count == 0 || (uint64_t)sector + count > d->sectors) return NULL;
+    return d;
+}
+
+DSTATUS ramdisk_initialize(BYTE unit) {
+    if (unit >= disk_count) return STA_NOINIT;
+    return disks[unit].read_only ? STA_PROTECT : 0;
+}
+
+DRESULT ramdisk_read(BYTE unit, BYTE *buff, LBA_t sector, UINT count) {
+    if (unit >= disk_count) return RES_NOTRDY;
+    ramdisk_t *d = ramdisk_unit(unit, sector, count);
+    if (!d) return RES_PARERR;
+
+    memcpy(buff, d->data + (uint32_t)sector * 512, count * 512);
+    return RES_OK;
+}
+
+DRESULT ramdisk_write(BYTE unit, const BYTE *buff, LBA_t sector, UINT count) {
+    if (unit >= disk_count) return RES_NOTRDY;
+    if (disks[unit].read_only) return RES_WRPRT;
+    ramdisk_t *d = ramdisk_unit(unit, sector, count);
+    if (!d) return RES_PARERR;
+
+    memcpy(d->data + (uint32_t)sector * 512, buff, count * 512);
+    return RES_OK;
+}
+
+DRESULT ramdisk_ioctl(BYTE unit, BYTE cmd, void *buff) {
+    if (unit >= disk_count) return RES_NOTRDY;
+
+    switch (cmd) {
+        case CTRL_SYNC:
+            return RES_OK;  // nothing is volatile beyond the RAM itself
+        case GET_SECTOR_COUNT:
+            *(LBA_t *)buff = disks[unit].sectors;
+            return RES_OK;
+        case GET_SECTOR_SIZE:
+            *(WORD *)buff = 512;
+            return RES_OK;
+        case GET_BLOCK_SIZE:
+            *(DWORD *)buff = 1;
+            return RES_OK;
+        default:
+            return RES_PARERR;
+    }
+}
@@ -0,0 +1,45 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ * 
+ * ramdisk.h
+ */
+
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include "ff.h"
+#include "diskio.h"
+#include <stdint.h>
+
+// Block devices kept in RAM above the kernel. Each one is a "unit"
+// numbered from 0; diskio.c registers them as physical drives.
+// The memory can't be given back, so a RAM disk lives until reboot.
+
+// Make a zero-filled disk of `sectors` 512-byte sectors.
+// Returns its unit number, or -1 when out of units or memory.
+int ramdisk_create(uint32_t sectors);
+
+// Serve an existing image in place, e.g. a boot module. Reads come
+// straight from `data`; nothing is copied up front.
+// Returns the unit number, or -1 when out of units.
+int ramdisk_attach(const BYTE *data, uint32_t sectors, int read_only);
+
+// Attach every boot module holding a FAT image as a read-only unit.
+// Returns the number of units added. Safe to call again.
+int ramdisk_attach_modules(void);
+
+// Number of units so far
+int ramdisk_count(void);
+
+// Size of a unit in sectors (0 if there is no such unit)
+uint32_t ramdisk_sectors(BYTE unit);
+int ramdisk_read_only(BYTE unit);
+
+DSTATUS ramdisk_initialize(BYTE unit);
+DRESULT ramdisk_read(BYTE unit, BYTE *buff, LBA_t sector, UINT count);
+DRESULT ramdisk_write(BYTE unit, const BYTE *buff, LBA_t sector, UINT count);
+DRESULT ramdisk_ioctl(BYTE unit, BYTE cmd, void *buff);
+
+#endif // RAMDISK_H
@@ -0,0 +1,258 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ *
+ * search.c
+ */
+
+#include "search.h"
+#include "walk.h"
+#include "disks.h"
+#include "keyboard.h"
+#include "stdlib.h"
+#include "string.h"
+#include "ctype.h"
+#include "console.h"
+#include "time.h"
+#include <stdint.h>
+
+#define GREP_CHUNK     (64 * 1024)   // bytes per f_read
+#define GREP_SHOW      56            // characters of a matching line shown
+
+//------------------------------------------------------------
+// Boyer-Moore-Horspool
+//------------------------------------------------------------
+static unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+int bmh_init(bmh_t *m, const char *pattern, int icase) {
+    size_t len = strlen(pattern);
+    if (len == 0 || len > SEARCH_MAX_PATTERN) return 0;
+
+    m->len = len;
+    m->icase = icase;
+    for (size_t i = 0; i < len; i++)
+        m->pat[i] = icase ? fold((unsigned char)pattern[i]) : (unsigned char)pattern[i];
+
+    // a byte that is not in the pattern lets the window jump its full length
+    for (int c = 0; c < 256; c++) m->skip[c] = len;
+    for (size_t i = 0; i + 1 < len; i++) {
+        m->skip[m->pat[i]] = len - 1 - i;
+        if (icase && m->pat[i] >= 'a' && m->pat[i] <= 'z')
+            m->skip[m->pat[i] - ('a' - 'A')] = len - 1 - i;
+    }
+    return 1;
+}
+
+const char *bmh_find(const bmh_t *m, const char *text, size_t len) {
+    const unsigned char *t = (const unsigned char *)text;
+    size_t n = m->len;
+    if (len < n) return NULL;
+
+    // one byte (or a case-sensitive first byte) is what memchr is for
+    if (n == 1 && (!m->icase || !isalpha(m->pat[0])))
+        return memchr(text, m->pat[0], len);
+
+    const unsigned char last = m->pat[n - 1];
+    size_t pos = 0;
+    while (pos <= len - n) {
+        unsigned char c = t[pos + n - 1];
+        unsigned char fc = m->icase ? fold(c) : c;
+        if (fc == last) {
+            size_t i = 0;
+            if (m->icase) {
+                while (i + 1 < n && fold(t[pos + i]) == m->pat[i]) i++;
+            } else {
+                while (i + 1 < n && t[pos + i] == m->pat[i]) i++;
+            }
+            if (i + 1 == n) return text + pos;
+        }
+        pos += m->skip[c];
+    }
+    return NULL;
+}
+
+//------------------------------------------------------------
+// grep
+//------------------------------------------------------------
+typedef struct {
+    bmh_t m;
+    char *buf;
+    uint32_t files;
+    uint32_t files_matched;
+    uint32_t matches;
+    uint32_t bytes;
+    int stop;
+} grep_ctx_t;
+
+static uint32_t count_newlines(const char *p, size_t len) {
+    uint32_t n = 0;
+    const char *end = p + len;
+    while (p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+        n++;
+        p++;
+    }
+    return n;
+}
+
+static void grep_report(const char *path, uint32_t line, const char *text, size_t len) {
+    char shown[GREP_SHOW + 1];
+    size_t n = 0;
+    for (size_t i = 0; i < len && n < GREP_SHOW; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '\r') continue;
+        shown[n++] = (c == '\t') ? ' ' : (c < ' ' ? '.' : (char)c);
+    }
+    shown[n] = '\0';
+    printf("%s:%u: %s\n", path, line, shown);
+}
+
+static void grep_file(grep_ctx_t *g, const char *path) {
+    FIL fil;
+    if (f_open(&fil, path, FA_READ) != FR_OK) {
+        printf("%s: cannot open\n", path);
+        return;
+    }
+    g->files++;
+
+    char *buf = g->buf;
+    size_t m = g->m.len;
+    size_t keep = 0;                 // carried from the last chunk: a partial line
+    uint32_t line = 1;               // line number of buf[0]
+    uint32_t last_reported = 0;
+    uint32_t found = 0;
+    int first = 1;
+    int binary = 0;
+
+    while (!g->stop) {
+        UINT br;
+        if (f_read(&fil, buf + keep, GREP_CHUNK - keep, &br) != FR_OK) {
+            printf("%s: read error\n", path);
+            break;
+        }
+        g->bytes += br;
+        size_t n = keep + br;
+        int eof = (br < GREP_CHUNK - keep);
+        if (n == 0) break;
+
+        if (first) {
+            binary = memchr(buf, '\0', n) != NULL;
+            first = 0;
+        }
+        if (binary) {
+            // no lines to show: say whether it matches at all
+            const char *hit = bmh_find(&g->m, buf, n);
+            if (hit) {
+                printf("%s: binary file matches\n", path);
+                found++;
+                break;
+            }
+            if (eof) break;
+            keep = (n >= m - 1) ? m - 1 : n;
+            memmove(buf, buf + n - keep, keep);
+            continue;
+        }
+
+        // search whole lines only; the partial last line waits for more data.
+        // [0, limit) is searched, [end, n) is carried into the next read.
+        size_t end = n;
+        size_t limit = n;
+        if (!eof) {
+            while (end > 0 && buf[end - 1] != '\n') end--;
+            if (end < n / 2) {
+                // one huge line: search all of it and carry the last m-1
+                // bytes, where no whole match can start
+                end = (n > m - 1) ? n - (m - 1) : 0;
+            } else {
+                limit = end;
+            }
+        }
+
+        size_t pos = 0;
+        const char *hit;
+        while (pos < end && (hit = bmh_find(&g->m, buf + pos, limit - pos)) != NULL) {
+            size_t at = hit - buf;
+            line += count_newlines(buf + pos, at - pos);
+
+            size_t ls = at;
+            while (ls > 0 && buf[ls - 1] != '\n') ls--;
+            const char *nl = memchr(buf + at, '\n', n - at);
+            size_t le = nl ? (size_t)(nl - buf) : n;
+
+            if (line != last_reported) {
+                grep_report(path, line, buf + ls, le - ls);
+                last_reported = line;
+                g->matches++;
+                found++;
+            }
+            if (le >= end) {
+                pos = end;
+                break;
+            }
+            pos = le + 1;
+            line++;
+        }
+        if (pos < end) line += count_newlines(buf + pos, end - pos);
+
+        if (eof) break;
+        keep = n - end;
+        memmove(buf, buf + end, keep);
+
+        if (getch_nb() == 27) g->stop = 1;
+    }
+
+    if (found) g->files_matched++;
+    f_close(&fil);
+}
+
+static int grep_visit(const walk_entry_t *e, void *ctx) {
+    grep_ctx_t *g = ctx;
+    if (e->fno->fattrib & AM_DIR) return WALK_CONTINUE;
+    grep_file(g, e->path);
+    if (!g->stop && getch_nb() == 27) g->stop = 1;
+    return g->stop ? WALK_STOP : WALK_CONTINUE;
+}
+
+void grep_files(const char *pattern, const char *path, const char *glob, int flags) {
+    grep_ctx_t g;
+    memset(&g, 0, sizeof(g));
+    if (!bmh_init(&g.m, pattern, flags & GREP_ICASE)) {
+        printf("Pattern must be 1 to %d characters.\n", SEARCH_MAX_PATTERN);
+        return;
+    }
+    g.buf = malloc(GREP_CHUNK);
+    if (!g.buf) {
+        println("Out of memory.");
+        return;
+    }
+
+    char full[MAX_PATH_LEN];
+    get_full_path(path, full);
+    size_t len = strlen(full);
+    if (len > 3 && full[len - 1] == '/') full[len - 1] = '\0';
+
+    uint32_t t0 = get_time_ms();
+    FILINFO fno;
+    int is_dir = (len <= 3) || (f_stat(full, &fno) == FR_OK && (fno.fattrib & AM_DIR));
+    if (is_dir) {
+        walk_filter_t filter = { 0 };
+        filter.name_glob = glob;
+        filter.attr_clear = AM_DIR;
+        FRESULT res = walk_tree(full, &filter, 0, grep_visit, &g);
+        if (res != FR_OK && g.files == 0) printf("%s: cannot read the directory\n", full);
+    } else {
+        grep_file(&g, full);
+    }
+    uint32_t ms = get_time_ms() - t0;
+    if (ms == 0) ms = 1;
+
+    uint32_t kb = g.bytes / 1024;
+    uint32_t kbps = (kb < 4000000) ? kb * 1000 / ms : kb / ms * 1000;
+    uint32_t mb10 = kbps * 10 / 1024;
+    printf("%u match(es) in %u of %u file(s); %u KB in %u ms (%u.%u MB/s)%s\n",
+           g.matches, g.files_matched, g.files, kb, ms, mb10 / 10, mb10 % 10,
+           g.stop ? " - stopped" : "");
+    free(g.buf);
+}
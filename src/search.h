@@ -0,0 +1,39 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ *
+ * search.h
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "ff.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define SEARCH_MAX_PATTERN 64
+
+#define GREP_ICASE 0x01   // ignore case (ASCII)
+
+// Boyer-Moore-Horspool matcher: the skip table is built once per pattern
+typedef struct {
+    unsigned char pat[SEARCH_MAX_PATTERN];   // folded if icase
+    size_t len;
+    int icase;
+    size_t skip[256];
+} bmh_t;
+
+// Returns 0 if the pattern is empty or longer than SEARCH_MAX_PATTERN
+int bmh_init(bmh_t *m, const char *pattern, int icase);
+
+// First occurrence of the pattern in text[0..len), or NULL
+const char *bmh_find(const bmh_t *m, const char *text, size_t len);
+
+// Print file:line: text for every line of path (a file, or a directory
+// searched recursively, optionally only names matching glob) that
+// contains pattern, then the totals and MB/s. Esc stops the search.
+void grep_files(const char *pattern, const char *path, const char *glob, int flags);
+
+#endif // SEARCH_H
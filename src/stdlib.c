@@ -352,21 +352,47 @@ int rand_r(unsigned int* seed) {
 }
 
 // ─── sorting / searching ───────────────────────────────────────────────────────
+static void qsort_swap(char* a, char* b, size_t size) {
+    if ((((uintptr_t)a | (uintptr_t)b | size) & 3) == 0) {
+        uint32_t* x = (uint32_t*)a;
+        uint32_t* y = (uint32_t*)b;
+        for (size_t k = 0; k < size / 4; k++) {
+            uint32_t tmp = x[k];
+            x[k] = y[k];
+            y[k] = tmp;
+        }
+        return;
+    }
+    for (size_t k = 0; k < size; k++) {
+        char tmp = a[k];
+        a[k] = b[k];
+        b[k] = tmp;
+    }
+}
+
+// move array[root] down until neither child of it is larger
+static void qsort_sift(char* array, size_t root, size_t count, size_t size,
+                       int (*cmp)(const void*, const void*)) {
+    while (1) {
+        size_t child = 2 * root + 1;
+        if (child >= count) return;
+        if (child + 1 < count && cmp(array + child * size, array + (child + 1) * size) < 0) child++;
+        if (cmp(array + root * size, array + child * size) >= 0) return;
+        qsort_swap(array + root * size, array + child * size, size);
+        root = child;
+    }
+}
+
+// heapsort: O(n log n) in the worst case, in place and without recursion,
+// which matters on the small kernel stack
 void qsort(void* base, size_t count, size_t size,
            int (*cmp)(const void*, const void*)) {
     char* array = (char*)base;
-    for (size_t i = 0; i < count - 1; i++) {
-        for (size_t j = 0; j < count - i - 1; j++) {
-            char* a = array + j * size;
-            char* b = array + (j + 1) * size;
-            if (cmp(a, b) > 0) {
-                for (size_t k = 0; k < size; k++) {
-                    char tmp = a[k];
-                    a[k] = b[k];
-                    b[k] = tmp;
-                }
-            }
-        }
+    if (count < 2) return;
+    for (size_t i = count / 2; i-- > 0; ) qsort_sift(array, i, count, size, cmp);
+    for (size_t end = count - 1; end > 0; end--) {
+        qsort_swap(array, array + end * size, size);
+        qsort_sift(array, 0, end, size, cmp);
     }
 }
 
@@ -390,38 +416,70 @@ int vsnprintf(char* buffer, unsigned int buf_size, const char* format, va_list a
     char* buf_ptr = buffer;
     unsigned int remaining = buf_size ? buf_size - 1 : 0;
     for (const char* f = format; *f && remaining; f++) {
-        if (*f == '%') {
-            f++;
+        if (*f != '%') {
+            *buf_ptr++ = *f;
+            remaining--;
+            continue;
+        }
+        f++;
+
+        // flags and field width: %-8s, %08x, %5u ...
+        int left = 0, zero = 0, width = 0;
+        for (;; f++) {
+            if (*f == '-') left = 1;
+            else if (*f == '0') zero = 1;
+            else break;
+        }
+        while (*f >= '0' && *f <= '9') width = width * 10 + (*f++ - '0');
+        while (*f == 'l') f++;  // long is 32 bits here, same as int
+
+        char temp[40];
+        const char* out = temp;
+        int len = 0;
+
+        if (*f == 'd' || *f == 'u' || *f == 'x' || *f == 'X') {
+            unsigned int uval;
+            int is_neg = 0;
             if (*f == 'd') {
                 int val = va_arg(args, int);
-                char temp[16];
-                // reuse itoa_base from string.c if available; else simple:
-                int is_neg = (val < 0);
-                unsigned int uval = is_neg ? -val : val;
-                int pos = 0;
-                if (is_neg) temp[pos++] = '-';
-                char rev[12]; int rpos = 0;
-                do {
-                    rev[rpos++] = '0' + (uval % 10);
-                    uval /= 10;
-                } while (uval);
-                while (rpos) temp[pos++] = rev[--rpos];
-                temp[pos] = '\0';
-                for (char* t = temp; *t && remaining; t++, remaining--) *buf_ptr++ = *t;
-            } else if (*f == 's') {
-                char* str = va_arg(args, char*);
-                for (; *str && remaining; str++, remaining--) *buf_ptr++ = *str;
-            } else if (*f == 'c') {
-                char c = (char)va_arg(args, int);
-                if (remaining) { *buf_ptr++ = c; remaining--; }
+                is_neg = (val < 0);
+                uval = is_neg ? 0u - (unsigned int)val : (unsigned int)val;
             } else {
-                if (remaining) { *buf_ptr++ = '%'; remaining--; }
-                if (remaining) { *buf_ptr++ = *f; remaining--; }
+                uval = va_arg(args, unsigned int);
+            }
+            unsigned int base = (*f == 'x' || *f == 'X') ? 16 : 10;
+            const char* digits = (*f == 'X') ? "0123456789ABCDEF" : "0123456789abcdef";
+
+            char rev[12]; int rpos = 0;
+            do {
+                rev[rpos++] = digits[uval % base];
+                uval /= base;
+            } while (uval);
+
+            if (is_neg) temp[len++] = '-';
+            // zero padding goes between the sign and the digits
+            if (zero && !left) {
+                while (len + rpos < width && len + rpos < (int)sizeof(temp)) temp[len++] = '0';
             }
+            while (rpos) temp[len++] = rev[--rpos];
+        } else if (*f == 's') {
+            out = va_arg(args, char*);
+            if (!out) out = "(null)";
+            while (out[len]) len++;
+        } else if (*f == 'c') {
+            temp[len++] = (char)va_arg(args, int);
+        } else if (*f == '%') {
+            temp[len++] = '%';
         } else {
-            *buf_ptr++ = *f;
-            remaining--;
+            temp[len++] = '%';
+            if (*f) temp[len++] = *f;
+            else f--;  // lone '%' at the end: stop the loop normally
         }
+
+        int pad = (width > len) ? width - len : 0;
+        if (!left) for (; pad && remaining; pad--, remaining--) *buf_ptr++ = ' ';
+        for (int i = 0; i < len && remaining; i++, remaining--) *buf_ptr++ = out[i];
+        if (left) for (; pad && remaining; pad--, remaining--) *buf_ptr++ = ' ';
     }
     if (buf_size) *buf_ptr = '\0';
     return (int)(buf_ptr - buffer);
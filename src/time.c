@@ -38,9 +38,9 @@
  }
  
 // Variable to store the number of PIT ticks
-static uint32_t pit_ticks = 0;
+static volatile uint32_t pit_ticks = 0;
 
-// This function is called in PIT interrupt handler
+// This function is called in PIT interrupt handler (timer_handler in irq.asm)
 // Increment the pit_ticks counter every time the PIT generates a tick (1ms)
 void pit_tick_increment(void) {
     pit_ticks++;
@@ -51,6 +51,30 @@ uint32_t get_time_ms(void) {
     return pit_ticks;
 }
 
+// Microseconds since boot: the tick count plus how far channel 0 has counted
+// down into the current tick. Wraps after about 71 minutes, so only use it
+// for differences.
+uint32_t get_time_us(void) {
+    static uint32_t last_us = 0;
+    uint32_t ticks, count;
+    do {
+        ticks = pit_ticks;
+        outb(PIT_COMMAND, 0x00);              /* counter latch, channel 0 */
+        count = inb(PIT_CHANNEL0);
+        count |= (uint32_t)inb(PIT_CHANNEL0) << 8;
+    } while (ticks != pit_ticks);
+
+    uint32_t reload = PIT_FREQUENCY / 1000;
+    if (count > reload) count = reload;
+    uint32_t us = ticks * 1000 + (reload - count) * 1000 / reload;
+
+    // With interrupts off the counter can wrap before the tick is counted;
+    // never let the clock step backwards because of that.
+    if ((int32_t)(us - last_us) < 0 && (int32_t)(last_us - us) < 1000) return last_us;
+    last_us = us;
+    return us;
+}
+
  int pit_out_high(void) {
      outb(PIT_COMMAND, PIT_READBACK);
      return inb(PIT_CHANNEL0) & 0x80; /* OUT is bit 7 */
@@ -19,6 +19,7 @@ struct tm {
 };
 
 void pit_init_for_polling(void);
+void pit_tick_increment(void);
 int pit_out_high(void);
 void delay_ms(uint32_t ms);
 
@@ -41,5 +42,6 @@ struct tm* localtime(const time_t* timer);
 char* asctime(const struct tm* timeptr);
 char* ctime(const time_t* timer);
 uint32_t get_time_ms(void);
+uint32_t get_time_us(void);
 
 #endif
@@ -0,0 +1,340 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ * 
+ * virtio_blk.c
+ */
+
+#include "virtio_blk.h"
+#include "pci.h"
+#include "pic.h"
+#include "port.h"
+#include "memory.h"
+#include "string.h"
+#include "time.h"
+#include <stdint.h>
+
+#define VIRTIO_VENDOR_ID          0x1AF4
+#define VIRTIO_BLK_LEGACY_ID      0x1001
+
+// legacy register block in I/O BAR0 (no MSI-X, so the device config
+// follows directly at 0x14)
+#define VIRTIO_PCI_HOST_FEATURES  0x00
+#define VIRTIO_PCI_GUEST_FEATURES 0x04
+#define VIRTIO_PCI_QUEUE_PFN      0x08
+#define VIRTIO_PCI_QUEUE_SIZE     0x0C
+#define VIRTIO_PCI_QUEUE_SEL      0x0E
+#define VIRTIO_PCI_QUEUE_NOTIFY   0x10
+#define VIRTIO_PCI_STATUS         0x12
+#define VIRTIO_PCI_ISR            0x13
+#define VIRTIO_BLK_CAPACITY       0x14   // 64-bit, in 512-byte sectors
+
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER      0x02
+#define VIRTIO_STATUS_DRIVER_OK   0x04
+#define VIRTIO_STATUS_FAILED      0x80
+
+#define VIRTIO_BLK_F_RO           (1u << 5)
+#define VIRTIO_BLK_F_FLUSH        (1u << 9)
+
+#define VIRTIO_BLK_T_IN           0
+#define VIRTIO_BLK_T_OUT          1
+#define VIRTIO_BLK_T_FLUSH        4
+#define VIRTIO_BLK_S_OK           0
+
+#define VRING_DESC_F_NEXT         1
+#define VRING_DESC_F_WRITE        2      // device writes into the buffer
+#define VRING_ALIGN               4096   // legacy layout: used ring on its own page
+
+#define VBLK_MAX_UNITS            4
+#define VBLK_MAX_REQS             64     // requests in flight; 3 descriptors each
+#define VBLK_REQ_MAX_SECTORS      256    // 128 KiB per request
+#define VBLK_TIMEOUT_MS           5000
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) vring_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} __attribute__((packed)) vring_avail_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t len;
+} __attribute__((packed)) vring_used_elem_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    vring_used_elem_t ring[];
+} __attribute__((packed)) vring_used_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) vblk_req_hdr_t;
+
+typedef struct {
+    uint16_t io;
+    uint8_t  read_only;
+    uint8_t  can_flush;
+    uint8_t  failed;              // a request timed out; the queue can't be trusted
+    uint16_t qsize;
+    uint16_t avail_idx;           // our copy of avail->idx
+    uint16_t used_idx;            // last used->idx we consumed
+    int      max_reqs;
+    uint64_t sectors;
+    vring_desc_t           *desc;
+    vring_avail_t          *avail;
+    volatile vring_used_t  *used;
+    vblk_req_hdr_t         *hdr;    // one per request slot
+    volatile uint8_t       *status; // one per request slot
+} vblk_dev_t;
+
+static vblk_dev_t devs[VBLK_MAX_UNITS];
+static int dev_count = 0;
+static int initialized = 0;
+
+static inline uint32_t vring_align(uint32_t x) {
+    return (x + VRING_ALIGN - 1) & ~(uint32_t)(VRING_ALIGN - 1);
+}
+
+//------------------------------------------------------------
+// Interrupt: reading the ISR acknowledges it and drops the line.
+// The waiter just watches used->idx; the interrupt only wakes it
+//------------------------------------------------------------
+static void vblk_irq(void *ctx) {
+    vblk_dev_t *d = (vblk_dev_t *)ctx;
+    inb(d->io + VIRTIO_PCI_ISR);
+}
+
+//------------------------------------------------------------
+// Requests. Slot r always uses descriptors 3r..3r+2:
+// header -> data (absent for a flush) -> status byte
+//------------------------------------------------------------
+static void vblk_fill(vblk_dev_t *d, int r, uint32_t type, BYTE *buf, uint64_t lba, UINT n) {
+    uint16_t head = (uint16_t)(r * 3);
+    uint16_t i = head;
+
+    d->hdr[r].type     = type;
+    d->hdr[r].reserved = 0;
+    d->hdr[r].sector   = lba;
+    d->status[r]       = 0xFF;
+
+    d->desc[i].addr  = (uint32_t)&d->hdr[r];   // no paging: virtual == physical
+    d->desc[i].len   = sizeof(vblk_req_hdr_t);
+    d->desc[i].flags = VRING_DESC_F_NEXT;
+    d->desc[i].next  = i + 1;
+    i++;
+
+    if (n) {
+        d->desc[i].addr  = (uint32_t)buf;
+        d->desc[i].len   = n * 512;
+        d->desc[i].flags = VRING_DESC_F_NEXT | (type == VIRTIO_BLK_T_IN ? VRING_DESC_F_WRITE : 0);
+        d->desc[i].next  = i + 1;
+        i++;
+    }
+
+    d->desc[i].addr  = (uint32_t)&d->status[r];
+    d->desc[i].len   = 1;
+    d->desc[i].flags = VRING_DESC_F_WRITE;
+    d->desc[i].next  = 0;
+
+    d->avail->ring[(uint16_t)(d->avail_idx + r) % d->qsize] = head;
+}
+
+// publish nreq filled slots with one notify and sleep until the device
+// has used all of them
+static int vblk_run(vblk_dev_t *d, int nreq) {
+    __asm__ volatile ("" ::: "memory");        // ring entries before the index
+    d->avail_idx += nreq;
+    d->avail->idx = d->avail_idx;
+    __asm__ volatile ("" ::: "memory");
+    outw(d->io + VIRTIO_PCI_QUEUE_NOTIFY, 0);
+    disk_note_commands(nreq);
+
+    uint16_t target = d->used_idx + nreq;
+    uint32_t start = get_time_ms();
+    for (;;) {
+        // check-then-halt atomically; the 1 ms timer tick bounds the sleep
+        // even if the interrupt line is not routed
+        asm volatile ("cli");
+        if (d->used->idx == target) {
+            asm volatile ("sti");
+            break;
+        }
+        if (get_time_ms() - start >= VBLK_TIMEOUT_MS) {
+            asm volatile ("sti");
+            disk_note_timeout();
+            d->failed = 1;
+            return -1;
+        }
+        asm volatile ("sti; hlt");
+    }
+    d->used_idx = target;
+
+    __asm__ volatile ("" ::: "memory");        // the device wrote our buffers
+    for (int r = 0; r < nreq; r++) {
+        if (d->status[r] != VIRTIO_BLK_S_OK) return -1;
+    }
+    return 0;
+}
+
+// split a transfer into requests of up to VBLK_REQ_MAX_SECTORS and keep
+// up to max_reqs of them in flight per notify
+static int vblk_transfer(vblk_dev_t *d, uint32_t type, BYTE *buf, uint64_t lba, UINT count) {
+    while (count > 0) {
+        int nreq = 0;
+        while (nreq < d->max_reqs && count > 0) {
+            UINT n = (count > VBLK_REQ_MAX_SECTORS) ? VBLK_REQ_MAX_SECTORS : count;
+            vblk_fill(d, nreq, type, buf, lba, n);
+            buf   += n * 512;
+            lba   += n;
+            count -= n;
+            nreq++;
+        }
+        if (vblk_run(d, nreq) < 0) return -1;
+    }
+    return 0;
+}
+
+//------------------------------------------------------------
+// Device bring-up
+//------------------------------------------------------------
+static int vblk_setup(vblk_dev_t *d, const pci_device_t *pci) {
+    uint16_t io = d->io;
+
+    outb(io + VIRTIO_PCI_STATUS, 0);  // reset
+    outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+    uint32_t features = inl(io + VIRTIO_PCI_HOST_FEATURES);
+    features &= VIRTIO_BLK_F_RO | VIRTIO_BLK_F_FLUSH;
+    outl(io + VIRTIO_PCI_GUEST_FEATURES, features);
+    d->read_only = (features & VIRTIO_BLK_F_RO) ? 1 : 0;
+    d->can_flush = (features & VIRTIO_BLK_F_FLUSH) ? 1 : 0;
+
+    outw(io + VIRTIO_PCI_QUEUE_SEL, 0);
+    d->qsize = inw(io + VIRTIO_PCI_QUEUE_SIZE);
+    if (d->qsize < 3) return -1;
+
+    // legacy devices dictate the queue size; lay the rings out for it
+    uint32_t q = d->qsize;
+    uint32_t used_off = vring_align(16 * q + 6 + 2 * q);
+    uint32_t bytes = used_off + vring_align(6 + 8 * q);
+
+    uint8_t *ring = high_alloc(bytes, VRING_ALIGN);
+    d->hdr    = high_alloc(VBLK_MAX_REQS * sizeof(vblk_req_hdr_t), 16);
+    d->status = high_alloc(VBLK_MAX_REQS, 4);
+    if (!ring || !d->hdr || !d->status) return -1;
+    memset(ring, 0, bytes);
+
+    d->desc  = (vring_desc_t *)ring;
+    d->avail = (vring_avail_t *)(ring + 16 * q);
+    d->used  = (volatile vring_used_t *)(ring + used_off);
+    d->avail_idx = 0;
+    d->used_idx  = 0;
+    d->max_reqs  = (int)(q / 3);
+    if (d->max_reqs > VBLK_MAX_REQS) d->max_reqs = VBLK_MAX_REQS;
+
+    outl(io + VIRTIO_PCI_QUEUE_PFN, (uint32_t)ring / VRING_ALIGN);
+
+    d->sectors = (uint64_t)inl(io + VIRTIO_BLK_CAPACITY)
+               | ((uint64_t)inl(io + VIRTIO_BLK_CAPACITY + 4) << 32);
+
+    // without a usable line the waiter still wakes on every timer tick
+    irq_install(pci->irq_line, vblk_irq, d);
+
+    outb(io + VIRTIO_PCI_STATUS,
+         VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+    return 0;
+}
+
+int virtio_blk_init(void) {
+    if (initialized) return dev_count;
+    initialized = 1;
+
+    pci_device_t pci;
+    for (int i = 0; dev_count < VBLK_MAX_UNITS &&
+                    pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_LEGACY_ID, i, &pci); i++) {
+        uint32_t io = pci_read_bar(&pci, 0);
+        if (io == 0) continue;
+
+        pci_enable(&pci, PCI_CMD_IO_SPACE | PCI_CMD_BUS_MASTER);
+
+        vblk_dev_t *d = &devs[dev_count];
+        memset(d, 0, sizeof(*d));
+        d->io = (uint16_t)io;
+
+        if (vblk_setup(d, &pci) < 0) {
+            outb(d->io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_FAILED);
+            continue;
+        }
+        dev_count++;
+    }
+    return dev_count;
+}
+
+//------------------------------------------------------------
+// Block device interface (diskio.c)
+//------------------------------------------------------------
+static vblk_dev_t* vblk_dev(BYTE unit) {
+    return (unit < dev_count && !devs[unit].failed) ? &devs[unit] : NULL;
+}
+
+DSTATUS virtio_blk_initialize(BYTE unit) {
+    vblk_dev_t *d = vblk_dev(unit);
+    if (!d) return STA_NOINIT;
+    return d->read_only ? STA_PROTECT : 0;
+}
+
+DRESULT virtio_blk_read(BYTE unit, BYTE *buff, LBA_t sector, UINT count) {
+    vblk_dev_t *d = vblk_dev(unit);
+    if (!d)                                          return RES_NOTRDY;
+    if (count == 0)                                  return RES_PARERR;
+    if ((uint64_t)sector + count > d->sectors)       return RES_PARERR;
+
+    return (vblk_transfer(d, VIRTIO_BLK_T_IN, buff, sector, count) == 0) ? RES_OK : RES_ERROR;
+}
+
+DRESULT virtio_blk_write(BYTE unit, const BYTE *buff, LBA_t sector, UINT count) {
+    vblk_dev_t *d = vblk_dev(unit);
+    if (!d)                                          return RES_NOTRDY;
+    if (d->read_only)                                return RES_WRPRT;
+    if (count == 0)                                  return RES_PARERR;
+    if ((uint64_t)sector + count > d->sectors)       return RES_PARERR;
+
+    // the device only reads from buff for writes
+    return (vblk_transfer(d, VIRTIO_BLK_T_OUT, (BYTE *)buff, sector, count) == 0) ? RES_OK : RES_ERROR;
+}
+
+DRESULT virtio_blk_ioctl(BYTE unit, BYTE cmd, void *buff) {
+    vblk_dev_t *d = vblk_dev(unit);
+    if (!d) return RES_NOTRDY;
+
+    switch (cmd) {
+        case CTRL_SYNC:
+            if (!d->can_flush) return RES_OK;  // no volatile cache to flush
+            vblk_fill(d, 0, VIRTIO_BLK_T_FLUSH, NULL, 0, 0);
+            return (vblk_run(d, 1) == 0) ? RES_OK : RES_ERROR;
+        case GET_SECTOR_COUNT:
+            *(LBA_t *)buff = (d->sectors > (LBA_t)-1) ? (LBA_t)-1 : (LBA_t)d->sectors;
+            return RES_OK;
+        case GET_SECTOR_SIZE:
+            *(WORD *)buff = 512;
+            return RES_OK;
+        case GET_BLOCK_SIZE:
+            *(DWORD *)buff = 1;
+            return RES_OK;
+        default:
+            return RES_PARERR;
+    }
+}
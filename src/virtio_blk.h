@@ -0,0 +1,28 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ * 
+ * virtio_blk.h
+ */
+
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include "ff.h"
+#include "diskio.h"
+#include <stdint.h>
+
+// Legacy (virtio 0.9.5) PCI block devices, 1AF4:1001, e.g. QEMU's
+// -drive if=virtio. Each device is a "unit" numbered from 0; diskio.c
+// registers them as physical drives.
+
+// Find and set up every device. Returns the number of units. Safe to call again.
+int virtio_blk_init(void);
+
+DSTATUS virtio_blk_initialize(BYTE unit);
+DRESULT virtio_blk_read(BYTE unit, BYTE *buff, LBA_t sector, UINT count);
+DRESULT virtio_blk_write(BYTE unit, const BYTE *buff, LBA_t sector, UINT count);
+DRESULT virtio_blk_ioctl(BYTE unit, BYTE cmd, void *buff);
+
+#endif // VIRTIO_BLK_H
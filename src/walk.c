@@ -0,0 +1,162 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ *
+ * walk.c
+ */
+
+#include "walk.h"
+#include "disks.h"
+#include "stdlib.h"
+#include "string.h"
+#include "ctype.h"
+#include <stdint.h>
+
+#define WALK_FIRST_DEPTH 8   // frames allocated up front; doubled as needed
+
+typedef struct {
+    DIR dir;
+    FILINFO info;            // the directory's own entry, for the post-order visit
+    UINT path_len;           // length of this directory's path in the buffer
+} walk_frame_t;
+
+int walk_glob(const char *pattern, const char *name) {
+    const char *star = 0;    // last '*' seen, and where its match ended
+    const char *resume = 0;
+
+    while (*name) {
+        if (*pattern == '*') {
+            star = pattern++;
+            resume = name;
+        } else if (*pattern == '?' || toupper((unsigned char)*pattern) == toupper((unsigned char)*name)) {
+            pattern++;
+            name++;
+        } else if (star) {
+            // let the last '*' swallow one more character
+            pattern = star + 1;
+            name = ++resume;
+        } else {
+            return 0;
+        }
+    }
+    while (*pattern == '*') pattern++;
+    return *pattern == '\0';
+}
+
+static int walk_match(const walk_filter_t *f, const FILINFO *fno) {
+    if (!f) return 1;
+    if (f->name_glob && !walk_glob(f->name_glob, fno->fname)) return 0;
+    if (fno->fsize < f->min_size) return 0;
+    if (f->max_size && fno->fsize > f->max_size) return 0;
+    if ((fno->fattrib & f->attr_set) != f->attr_set) return 0;
+    if (fno->fattrib & f->attr_clear) return 0;
+    return 1;
+}
+
+FRESULT walk_tree(const char *root, const walk_filter_t *filter, int flags,
+                  walk_visit_t visit, void *ctx) {
+    char *path = malloc(MAX_PATH_LEN);
+    UINT cap = WALK_FIRST_DEPTH;
+    walk_frame_t *stack = malloc(cap * sizeof(walk_frame_t));
+    if (!path || !stack) {
+        free(path);
+        free(stack);
+        return FR_NOT_ENOUGH_CORE;
+    }
+
+    get_full_path(root, path);
+    UINT len = strlen(path);
+    while (len > 3 && path[len - 1] == '/') path[--len] = '\0';   // keep "0:/"
+
+    FRESULT res = f_opendir(&stack[0].dir, path);
+    if (res != FR_OK) {
+        free(stack);
+        free(path);
+        return res;
+    }
+    stack[0].path_len = len;
+
+    FRESULT last_err = FR_OK;
+    UINT top = 0;            // index of the innermost open directory
+    int stop = 0;
+    FILINFO fno;
+    walk_entry_t e;
+    e.path = path;
+    e.fno = &fno;
+
+    while (1) {
+        walk_frame_t *fr = &stack[top];
+        res = stop ? FR_OK : f_readdir(&fr->dir, &fno);
+
+        if (stop || res != FR_OK || fno.fname[0] == 0) {
+            // this directory is done; the path still names it
+            if (res != FR_OK) last_err = res;
+            f_closedir(&fr->dir);
+            if (top == 0) break;
+            top--;
+
+            if ((flags & WALK_POSTORDER) && !stop && walk_match(filter, &fr->info)) {
+                e.fno = &fr->info;
+                e.depth = top;
+                e.leaving = 1;
+                if (visit(&e, ctx) == WALK_STOP) stop = 1;
+                e.fno = &fno;
+            }
+            path[stack[top].path_len] = '\0';
+            continue;
+        }
+
+        if (fno.fname[0] == '.' && (fno.fname[1] == '\0' || (fno.fname[1] == '.' && fno.fname[2] == '\0')))
+            continue;
+
+        // path of the entry: "<dir>/<name>" ("0:/" already ends in '/')
+        UINT base = fr->path_len;
+        UINT name_len = strlen(fno.fname);
+        UINT sep = (path[base - 1] == '/') ? 0 : 1;
+        if (base + sep + name_len + 1 > MAX_PATH_LEN) {
+            last_err = FR_INVALID_NAME;
+            continue;
+        }
+        if (sep) path[base] = '/';
+        memcpy(path + base + sep, fno.fname, name_len + 1);
+
+        int r = WALK_CONTINUE;
+        if (walk_match(filter, &fno)) {
+            e.depth = top;
+            e.leaving = 0;
+            r = visit(&e, ctx);
+        }
+        if (r == WALK_STOP) {
+            stop = 1;
+            path[base] = '\0';
+            continue;
+        }
+
+        if ((fno.fattrib & AM_DIR) && r != WALK_SKIP) {
+            if (top + 1 == cap) {
+                walk_frame_t *bigger = realloc(stack, cap * 2 * sizeof(walk_frame_t));
+                if (!bigger) {
+                    last_err = FR_NOT_ENOUGH_CORE;
+                    path[base] = '\0';
+                    continue;
+                }
+                stack = bigger;
+                cap *= 2;
+            }
+            res = f_opendir(&stack[top + 1].dir, path);
+            if (res == FR_OK) {
+                top++;
+                stack[top].info = fno;
+                stack[top].path_len = base + sep + name_len;
+                continue;        // the path stays extended while we're inside
+            }
+            last_err = res;
+        }
+        path[base] = '\0';
+    }
+
+    free(stack);
+    free(path);
+    return last_err;
+}
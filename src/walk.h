@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) Turrnut Open Source Organization
+ * Under the GPL v3 License
+ * See COPYING for information on how you can use this file
+ *
+ * walk.h
+ */
+
+#ifndef WALK_H
+#define WALK_H
+
+#include "ff.h"
+#include <stdint.h>
+
+// Depth-first walk over a directory tree. The open directories are kept
+// on a heap stack, not the kernel stack, so tree depth is only limited by
+// the path length.
+
+#define WALK_CONTINUE 0   // visitor results
+#define WALK_SKIP     1   // don't descend into this directory
+#define WALK_STOP     2   // end the walk (walk_tree returns FR_OK)
+
+#define WALK_POSTORDER 0x01  // also visit each directory after its contents
+
+typedef struct {
+    const char *name_glob;   // '*' and '?', case-insensitive; NULL = any name
+    DWORD min_size;
+    DWORD max_size;          // 0 = no limit
+    BYTE attr_set;           // entry must have all of these AM_ bits
+    BYTE attr_clear;         // ... and none of these
+} walk_filter_t;
+
+typedef struct {
+    const char *path;        // full path, e.g. "0:/DOCS/A.TXT"
+    const FILINFO *fno;
+    int depth;               // 0 = directly inside the walk's root
+    int leaving;             // 1 on the post-order visit of a directory
+} walk_entry_t;
+
+typedef int (*walk_visit_t)(const walk_entry_t *e, void *ctx);
+
+// Visit every entry below root (drive letter + path or relative path) that
+// passes the filter (NULL = all). Directories are entered whether or not
+// they pass. A subdirectory that cannot be read is skipped and the walk
+// goes on; the last such error is returned.
+FRESULT walk_tree(const char *root, const walk_filter_t *filter, int flags,
+                  walk_visit_t visit, void *ctx);
+
+// Match name against a '*'/'?' pattern, ignoring case
+int walk_glob(const char *pattern, const char *name);
+
+#endif // WALK_H